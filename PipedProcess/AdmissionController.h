@@ -0,0 +1,273 @@
+// This file is part of the PipedProcess project.
+// See LICENSE file for further information
+// https://github.com/fmuecke/PipedProcess
+
+// Admission control for runs that are started from many threads at once.
+// An AdmissionController enforces global budgets on the number of running children,
+// the pipe handles they use and the output they have buffered. Runs that do not fit
+// wait in priority order (FIFO within the same priority) until earlier runs have finished,
+// so an overload is turned into queuing instead of failing process creations.
+
+#pragma once
+
+#include "ProcessMetrics.h"
+#include <Windows.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <utility>
+
+class AdmissionController;
+
+// Resources of an admitted run; they are given back when the ticket is released or destroyed
+// The child slot and the pipe handles can be given back as soon as the run has ended,
+// the buffered output once the caller has fetched it.
+class AdmissionTicket
+{
+public:
+    AdmissionTicket() = default;
+    ~AdmissionTicket() { Release(); }
+
+    AdmissionTicket(const AdmissionTicket&) = delete; // non-copyable
+    AdmissionTicket& operator=(const AdmissionTicket&) = delete; // non-assignable
+
+    // Hand the admission over to a run that outlives the caller (e.g. an in-process command)
+    AdmissionTicket& operator=(AdmissionTicket&& other) noexcept;
+
+    bool IsAdmitted() const { return pController != nullptr; }
+
+    // Account output that has been buffered by the run
+    void AddBufferedBytes(size_t bytes);
+
+    // Give back the child slot and the pipe handles; the buffered output stays accounted
+    void ReleaseChild();
+
+    // Give back buffered output that has been fetched (at most the accounted bytes)
+    void ReleaseBufferedBytes(size_t bytes);
+
+    void Release();
+
+private:
+    friend class AdmissionController;
+
+    AdmissionController* pController{ nullptr };
+    size_t pipeHandles{ 0 };
+    bool holdsChild{ false };
+    std::atomic<size_t> bufferedBytes{ 0 }; // updated by the stdout and stderr reader threads
+};
+
+// Gives back the child slot of a ticket when the run ends, e.g. on an early error return
+class AdmissionChildGuard
+{
+public:
+    explicit AdmissionChildGuard(AdmissionTicket& ticket) : ticket(ticket)
+    {}
+
+    ~AdmissionChildGuard() { ticket.ReleaseChild(); }
+
+    AdmissionChildGuard(const AdmissionChildGuard&) = delete;
+    AdmissionChildGuard& operator=(const AdmissionChildGuard&) = delete;
+
+private:
+    AdmissionTicket& ticket;
+};
+
+class AdmissionController
+{
+public:
+    static constexpr size_t pipeHandlesPerRun = 6; // stdin, stdout and stderr pipe of a child process
+
+    // Budgets of 0 are unlimited
+    // The buffered bytes budget is a soft limit: runs are not admitted while it is exceeded,
+    // but running children are not stopped from producing more output (see PipedProcess::SetOutputLimit).
+    // Output counts against it until it has been fetched from the PipedProcess or the next run starts.
+    explicit AdmissionController(size_t maxChildren, size_t maxPipeHandles = 0, size_t maxBufferedBytes = 0)
+        : maxChildren(maxChildren), maxPipeHandles(maxPipeHandles), maxBufferedBytes(maxBufferedBytes)
+    {}
+
+    AdmissionController(const AdmissionController&) = delete; // non-copyable
+    AdmissionController& operator=(const AdmissionController&) = delete; // non-assignable
+
+    // Wait until a run with the specified number of pipe handles fits into the budgets
+    // Runs with a higher priority are admitted first. isAborted() is checked regularly while waiting.
+    // Returns NO_ERROR, ERROR_TIMEOUT or ERROR_PROCESS_ABORTED.
+    template<class F>
+    DWORD Acquire(AdmissionTicket& ticket, size_t pipeHandles, int priority, DWORD timeoutMs, F&& isAborted)
+    {
+        using Clock = std::chrono::steady_clock;
+        ticket.Release();
+
+        const auto start = Clock::now();
+        const auto deadline = timeoutMs == INFINITE ? (Clock::time_point::max)() : start + std::chrono::milliseconds(timeoutMs);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        const auto position = waiters.emplace(-priority, nextSequence++).first;
+
+        for (;;)
+        {
+            if (position == waiters.begin() && Fits(pipeHandles))
+            {
+                waiters.erase(position);
+                ++children;
+                usedPipeHandles += pipeHandles;
+                ticket.pController = this;
+                ticket.pipeHandles = pipeHandles;
+                ticket.holdsChild = true;
+                ticket.bufferedBytes = 0;
+
+                ++admitted;
+                waitTime.Record(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start));
+                changed.notify_all(); // the next waiter might fit as well
+                return NO_ERROR;
+            }
+
+            const auto now = Clock::now();
+            const DWORD error = isAborted() ? ERROR_PROCESS_ABORTED : (now >= deadline ? ERROR_TIMEOUT : NO_ERROR);
+            if (error != NO_ERROR)
+            {
+                waiters.erase(position);
+                ++rejected;
+                changed.notify_all();
+                return error;
+            }
+
+            // wake up regularly to check isAborted
+            const auto slice = std::chrono::milliseconds(50);
+            changed.wait_until(lock, deadline - now < slice ? deadline : now + slice);
+        }
+    }
+
+    // Try to admit a run without waiting longer than timeoutMs
+    DWORD TryAcquire(AdmissionTicket& ticket, size_t pipeHandles, int priority = 0, DWORD timeoutMs = 0)
+    {
+        return Acquire(ticket, pipeHandles, priority, timeoutMs, []() { return false; });
+    }
+
+    size_t QueueDepth() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return waiters.size();
+    }
+
+    size_t RunningChildren() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return children;
+    }
+
+    size_t PipeHandles() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return usedPipeHandles;
+    }
+
+    size_t BufferedBytes() const { return bufferedBytes.load(std::memory_order_relaxed); }
+
+    uint64_t Admitted() const { return admitted; }
+    uint64_t Rejected() const { return rejected; } // timed out or aborted while waiting
+
+    // Time from the request until admission
+    LatencyHistogram const& WaitTime() const { return waitTime; }
+
+private:
+    friend class AdmissionTicket;
+
+    bool Fits(size_t pipeHandles) const
+    {
+        return (maxChildren == 0 || children < maxChildren) &&
+            (maxPipeHandles == 0 || usedPipeHandles + pipeHandles <= maxPipeHandles) &&
+            (maxBufferedBytes == 0 || bufferedBytes.load(std::memory_order_relaxed) < maxBufferedBytes);
+    }
+
+    void ReleaseChild(AdmissionTicket const& ticket)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --children;
+            usedPipeHandles -= ticket.pipeHandles;
+        }
+        changed.notify_all();
+    }
+
+    void ReleaseBufferedBytes(size_t bytes)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            bufferedBytes.fetch_sub(bytes, std::memory_order_relaxed);
+        }
+        changed.notify_all();
+    }
+
+    const size_t maxChildren;
+    const size_t maxPipeHandles;
+    const size_t maxBufferedBytes;
+
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::set<std::pair<int, uint64_t>> waiters; // (-priority, sequence) in admission order
+    uint64_t nextSequence{ 0 };
+    size_t children{ 0 };
+    size_t usedPipeHandles{ 0 };
+    std::atomic<size_t> bufferedBytes{ 0 }; // updated by the reader threads without locking
+
+    std::atomic<uint64_t> admitted{ 0 };
+    std::atomic<uint64_t> rejected{ 0 };
+    LatencyHistogram waitTime;
+};
+
+inline void AdmissionTicket::AddBufferedBytes(size_t bytes)
+{
+    if (pController)
+    {
+        bufferedBytes += bytes;
+        pController->bufferedBytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+}
+
+inline AdmissionTicket& AdmissionTicket::operator=(AdmissionTicket&& other) noexcept
+{
+    if (this != &other)
+    {
+        Release();
+        pController = other.pController;
+        pipeHandles = other.pipeHandles;
+        holdsChild = other.holdsChild;
+        bufferedBytes = other.bufferedBytes.load();
+        other.pController = nullptr;
+        other.holdsChild = false;
+    }
+    return *this;
+}
+
+inline void AdmissionTicket::ReleaseChild()
+{
+    if (pController && holdsChild)
+    {
+        pController->ReleaseChild(*this);
+        holdsChild = false;
+    }
+}
+
+inline void AdmissionTicket::ReleaseBufferedBytes(size_t bytes)
+{
+    const auto accounted = bufferedBytes.load();
+    const auto released = bytes < accounted ? bytes : accounted;
+    if (pController && released > 0)
+    {
+        bufferedBytes -= released;
+        pController->ReleaseBufferedBytes(released);
+    }
+}
+
+inline void AdmissionTicket::Release()
+{
+    if (pController)
+    {
+        ReleaseChild();
+        ReleaseBufferedBytes(bufferedBytes.load());
+        pController = nullptr;
+    }
+}
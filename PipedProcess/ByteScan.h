@@ -0,0 +1,159 @@
+// This file is part of the PipedProcess project.
+// See LICENSE file for further information
+// https://github.com/fmuecke/PipedProcess
+
+// Vectorized byte and pattern search used to scan the output of child processes while it is read.
+// AVX2 is used if the compiler targets it (/arch:AVX2), SSE2 on all x64 and SSE2 enabled x86 targets,
+// and a scalar fallback otherwise.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BYTESCAN_AVX2
+#elif defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BYTESCAN_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace ByteScan
+{
+    constexpr size_t npos = std::string::npos;
+
+    // Returns the index of the lowest set bit (mask must not be 0)
+    inline unsigned LowestBit(uint32_t mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index{ 0 };
+        _BitScanForward(&index, mask);
+        return index;
+#else
+        return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+    }
+
+    inline unsigned BitCount(uint32_t mask)
+    {
+        mask = mask - ((mask >> 1) & 0x55555555u);
+        mask = (mask & 0x33333333u) + ((mask >> 2) & 0x33333333u);
+        return (((mask + (mask >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+    }
+
+#if defined(BYTESCAN_AVX2)
+    constexpr size_t blockSize = 32;
+    using Block = __m256i;
+    inline Block Load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    inline Block Splat(char c) { return _mm256_set1_epi8(c); }
+    inline Block Equal(Block a, Block b) { return _mm256_cmpeq_epi8(a, b); }
+    inline Block And(Block a, Block b) { return _mm256_and_si256(a, b); }
+    inline uint32_t Mask(Block b) { return static_cast<uint32_t>(_mm256_movemask_epi8(b)); }
+#elif defined(BYTESCAN_SSE2)
+    constexpr size_t blockSize = 16;
+    using Block = __m128i;
+    inline Block Load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    inline Block Splat(char c) { return _mm_set1_epi8(c); }
+    inline Block Equal(Block a, Block b) { return _mm_cmpeq_epi8(a, b); }
+    inline Block And(Block a, Block b) { return _mm_and_si128(a, b); }
+    inline uint32_t Mask(Block b) { return static_cast<uint32_t>(_mm_movemask_epi8(b)); }
+#endif
+
+    // Returns the index of the first occurrence of c in data or npos
+    inline size_t FindByte(const char* data, size_t size, char c)
+    {
+        size_t i{ 0 };
+#if defined(BYTESCAN_AVX2) || defined(BYTESCAN_SSE2)
+        const auto needle = Splat(c);
+        for (; i + blockSize <= size; i += blockSize)
+        {
+            auto mask = Mask(Equal(Load(data + i), needle));
+            if (mask != 0)
+            {
+                return i + LowestBit(mask);
+            }
+        }
+#endif
+        for (; i < size; ++i)
+        {
+            if (data[i] == c)
+            {
+                return i;
+            }
+        }
+        return npos;
+    }
+
+    // Returns the number of occurrences of c in data
+    inline size_t CountByte(const char* data, size_t size, char c)
+    {
+        size_t count{ 0 };
+        size_t i{ 0 };
+#if defined(BYTESCAN_AVX2) || defined(BYTESCAN_SSE2)
+        const auto needle = Splat(c);
+        for (; i + blockSize <= size; i += blockSize)
+        {
+            count += BitCount(Mask(Equal(Load(data + i), needle)));
+        }
+#endif
+        for (; i < size; ++i)
+        {
+            count += data[i] == c ? 1 : 0;
+        }
+        return count;
+    }
+
+    // Returns the index of the first occurrence of the pattern in data or npos
+    // Candidates are found by comparing the first and last byte of the pattern for a whole block at once.
+    inline size_t FindPattern(const char* data, size_t size, const char* pattern, size_t patternSize)
+    {
+        if (patternSize == 0)
+        {
+            return 0;
+        }
+        if (patternSize == 1)
+        {
+            return FindByte(data, size, pattern[0]);
+        }
+        if (patternSize > size)
+        {
+            return npos;
+        }
+
+        const auto last = patternSize - 1;
+        size_t i{ 0 };
+#if defined(BYTESCAN_AVX2) || defined(BYTESCAN_SSE2)
+        const auto firstByte = Splat(pattern[0]);
+        const auto lastByte = Splat(pattern[last]);
+        for (; i + last + blockSize <= size; i += blockSize)
+        {
+            auto mask = Mask(And(Equal(Load(data + i), firstByte), Equal(Load(data + i + last), lastByte)));
+            while (mask != 0)
+            {
+                auto bit = LowestBit(mask);
+                if (std::memcmp(data + i + bit + 1, pattern + 1, patternSize - 2) == 0)
+                {
+                    return i + bit;
+                }
+                mask &= mask - 1;
+            }
+        }
+#endif
+        for (; i + last < size; ++i)
+        {
+            if (data[i] == pattern[0] && data[i + last] == pattern[last] &&
+                std::memcmp(data + i + 1, pattern + 1, patternSize - 2) == 0)
+            {
+                return i;
+            }
+        }
+        return npos;
+    }
+}
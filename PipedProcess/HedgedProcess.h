@@ -0,0 +1,359 @@
+// This file is part of the PipedProcess project.
+// See LICENSE file for further information
+// https://github.com/fmuecke/PipedProcess
+
+#pragma once
+
+#include "PipedProcess.h"
+#include "ProcessMetrics.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Limits the number of hedge attempts that are in flight at the same time.
+// A limiter can be shared by many HedgedProcess instances to cap the extra load caused by hedging.
+class HedgeLimiter
+{
+public:
+    explicit HedgeLimiter(unsigned maxInFlight) : maxInFlight(maxInFlight)
+    {}
+
+    bool TryAcquire()
+    {
+        auto current = inFlight.load(std::memory_order_relaxed);
+        do
+        {
+            if (current >= maxInFlight)
+            {
+                return false;
+            }
+        } while (!inFlight.compare_exchange_weak(current, current + 1, std::memory_order_relaxed));
+
+        return true;
+    }
+
+    void Release() { inFlight.fetch_sub(1, std::memory_order_relaxed); }
+
+    unsigned InFlight() const { return inFlight.load(std::memory_order_relaxed); }
+
+private:
+    const unsigned maxInFlight;
+    std::atomic<unsigned> inFlight{ 0 };
+};
+
+// Defines when a duplicate (hedge) of a still running child process is launched
+struct HedgePolicy
+{
+    // Launch a hedge if the previous attempt did not finish within this delay (0 = no hedging)
+    std::chrono::microseconds delay{ 0 };
+
+    // If set (0..100), the delay is taken from this percentile of the program's hedged latency histogram
+    // in ProcessMetrics::Global() as soon as it contains minSamples runs; delay is used until then.
+    // The hedged latency is the time from the first launch until the winner exited, so hedges and
+    // aborted attempts do not cut off the tail of the distribution.
+    double percentile{ 0 };
+    uint64_t minSamples{ 100 };
+
+    // Maximum number of attempts including the first one
+    unsigned maxAttempts{ 2 };
+
+    // Optional limiter for the hedges in flight
+    // It must outlive all attempts using it, including aborted attempts that are still being reaped.
+    HedgeLimiter* pLimiter{ nullptr };
+};
+
+// This class runs an idempotent command and launches duplicates of it if it takes unusually long.
+// The result of the first attempt to run to completion is used, all other attempts are aborted.
+// Attempts that fail (e.g. the process can not be created) do not win; the error of the initial
+// attempt is returned only if all attempts failed.
+class HedgedProcess
+{
+public:
+    HedgedProcess()
+    {}
+
+    ~HedgedProcess()
+    {}
+
+    HedgedProcess(const HedgedProcess&) = delete; // non-copyable
+    HedgedProcess& operator=(const HedgedProcess&) = delete; // non-assignable
+
+    void SetPolicy(HedgePolicy const& hedgePolicy) { policy = hedgePolicy; }
+
+    // Set the window mode for the child processes (default is hidden)
+    void SetWindowMode(PipedProcess::WindowMode mode) { windowMode = mode; }
+
+    // Set the data that should be written to the standard input stream of every attempt
+    void SetStdInData(const char* pData, size_t len)
+    {
+        std::string tmp(pData, pData + len);
+        stdInBytes.swap(tmp);
+    }
+
+    // Run the program with the specified arguments, hedging according to the policy
+    DWORD Run(const char* program, const char* arguments)
+    {
+        PipedProcess::EmptyAbortEvent abortEvent;
+        return Run(program, arguments, abortEvent);
+    }
+
+    // Run the program with the specified arguments and abort event, hedging according to the policy
+    // The abort event is only checked from the calling thread.
+    template<class T>
+    DWORD Run(const char* program, const char* arguments, T& abortEvent)
+    {
+        attempts.clear();
+        stdOutBytes.clear();
+        stdErrBytes.clear();
+        winningAttempt = 0;
+
+        auto state = std::make_shared<HedgeState>();
+        state->hasProgram = program != nullptr;
+        state->program = program ? program : "";
+        state->arguments = arguments;
+        const auto programName = ProcessMetrics::ProgramName(program, arguments);
+
+        const auto started = Clock::now();
+        auto result = Launch(state, false);
+        if (result != NO_ERROR)
+        {
+            return result;
+        }
+
+        const auto hedgeDelay = GetHedgeDelay(programName.c_str());
+        const auto never = (Clock::time_point::max)();
+        auto nextHedge = hedgeDelay.count() > 0 && policy.maxAttempts > 1 ? Clock::now() + hedgeDelay : never;
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        auto isDecided = [this, &state]() { return state->winner >= 0 || state->failures == attempts.size(); };
+        while (!isDecided())
+        {
+            // check the abort event at the same interval as PipedProcess::Run
+            auto wakeUp = Clock::now() + std::chrono::milliseconds(50);
+            if (nextHedge < wakeUp)
+            {
+                wakeUp = nextHedge;
+            }
+
+            if (state->finished.wait_until(lock, wakeUp, isDecided))
+            {
+                break;
+            }
+
+            if (abortEvent.IsSet())
+            {
+                for (auto& attempt : attempts)
+                {
+                    attempt->abort = true;
+                }
+                nextHedge = never;
+            }
+            else if (Clock::now() >= nextHedge)
+            {
+                if (!policy.pLimiter || policy.pLimiter->TryAcquire())
+                {
+                    Launch(state, true);
+                }
+                nextHedge = attempts.size() < policy.maxAttempts ? Clock::now() + hedgeDelay : never;
+            }
+        }
+        winningAttempt = state->winner >= 0 ? static_cast<unsigned>(state->winner) : 0; // all attempts failed
+        const bool hasWinner = state->winner >= 0;
+        lock.unlock();
+
+        auto& metrics = ProcessMetrics::Global();
+        if (hasWinner && metrics.IsEnabled())
+        {
+            auto latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started);
+            metrics.ForProgram(programName.c_str()).hedgedLatency.Record(latency);
+        }
+
+        // abort the losers and reap them on another thread, so neither this nor the next run waits for them
+        std::vector<std::unique_ptr<Attempt>> losers;
+        for (unsigned i = 0; i < attempts.size(); ++i)
+        {
+            if (i != winningAttempt)
+            {
+                attempts[i]->abort = true;
+                losers.push_back(std::move(attempts[i]));
+            }
+        }
+        Reap(std::move(losers));
+
+        auto& winner = *attempts[winningAttempt];
+        result = winner.result.get();
+        stdOutBytes = winner.process.FetchStdOutData();
+        stdErrBytes = winner.process.FetchStdErrData();
+        runStatistics = winner.process.GetRunStatistics();
+
+        return result;
+    }
+
+    // Index of the attempt whose result was used in the last run (0 = the initial attempt)
+    unsigned WinningAttempt() const { return winningAttempt; }
+
+    // Number of attempts that were launched in the last run (including the initial attempt)
+    unsigned AttemptCount() const { return static_cast<unsigned>(attempts.size()); }
+
+    // Get the statistics of the winning attempt of the last run
+    PipedProcess::RunStatistics const& GetRunStatistics() const { return runStatistics; }
+
+    bool HasStdOutData() const { return !stdOutBytes.empty(); } // check if there is data available to read on stdout
+    bool HasStdErrData() const { return !stdErrBytes.empty(); } // check if there is data available to read on stderr
+
+    // Fetch the data that was written to the winning child process' standard output stream
+    std::string FetchStdOutData()
+    {
+        std::string ret;
+        ret.swap(stdOutBytes);
+        return ret;
+    }
+
+    // Fetch the data that was written to the winning child process' standard error stream
+    std::string FetchStdErrData()
+    {
+        std::string ret;
+        ret.swap(stdErrBytes);
+        return ret;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Shared between the run and its attempts, as aborted attempts may outlive the run
+    struct HedgeState
+    {
+        std::mutex mutex;
+        std::condition_variable finished;
+        int winner{ -1 };   // first attempt that ran to completion
+        size_t failures{ 0 }; // attempts that did not run to completion
+        bool hasProgram{ true }; // false if the program is taken from the command line
+        std::string program;
+        std::string arguments;
+    };
+
+    struct Attempt
+    {
+        struct AbortEvent
+        {
+            std::atomic<bool> const& flag;
+            bool IsSet() const { return flag.load(std::memory_order_relaxed); }
+        };
+
+        PipedProcess process;
+        std::atomic<bool> abort{ false };
+        std::future<DWORD> result; // declared last: waits for the attempt before the process is destroyed
+    };
+
+    // Launch another attempt of the run
+    DWORD Launch(std::shared_ptr<HedgeState> const& state, bool isHedge)
+    {
+        auto attempt = std::make_unique<Attempt>();
+        attempt->process.SetWindowMode(windowMode);
+        attempt->process.SetHandleInheritance(PipedProcess::HandleInheritance::StdHandlesOnly); // attempts run concurrently
+        attempt->process.SetStdInData(stdInBytes.data(), stdInBytes.size());
+
+        auto pAttempt = attempt.get();
+        auto index = static_cast<int>(attempts.size());
+        auto pLimiter = isHedge ? policy.pLimiter : nullptr;
+
+        try
+        {
+            attempt->result = std::async(std::launch::async, [state, pAttempt, index, pLimiter]()
+            {
+                Attempt::AbortEvent abortEvent{ pAttempt->abort };
+                auto program = state->hasProgram ? state->program.c_str() : nullptr;
+                auto exitCode = pAttempt->process.Run(program, state->arguments.c_str(), abortEvent);
+                if (pLimiter)
+                {
+                    pLimiter->Release();
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (!pAttempt->process.HasRunCompleted())
+                    {
+                        ++state->failures;
+                    }
+                    else if (state->winner < 0)
+                    {
+                        state->winner = index;
+                    }
+                }
+                state->finished.notify_all();
+
+                return exitCode;
+            });
+        }
+        catch (std::system_error& e)
+        {
+            if (pLimiter)
+            {
+                pLimiter->Release();
+            }
+
+            if (!isHedge)
+            {
+                auto msg = "Error starting attempt: " + e.code().message();
+                stdErrBytes = { msg.data(), msg.data() + msg.size() };
+            }
+            return e.code().value();
+        }
+
+        attempts.push_back(std::move(attempt));
+        return NO_ERROR;
+    }
+
+    // Wait for aborted attempts to finish and destroy them on a detached thread
+    static void Reap(std::vector<std::unique_ptr<Attempt>> losers)
+    {
+        if (losers.empty())
+        {
+            return;
+        }
+
+        auto pLosers = std::make_shared<std::vector<std::unique_ptr<Attempt>>>(std::move(losers));
+        try
+        {
+            std::thread([pLosers]() { pLosers->clear(); }).detach();
+        }
+        catch (std::system_error&)
+        {
+            pLosers->clear(); // no thread available: wait for the losers here
+        }
+    }
+
+    // Get the delay after which the next hedge is launched
+    std::chrono::microseconds GetHedgeDelay(const char* program) const
+    {
+        auto& metrics = ProcessMetrics::Global();
+        if (policy.percentile > 0 && metrics.IsEnabled())
+        {
+            auto& latency = metrics.ForProgram(program).hedgedLatency;
+            if (latency.Count() >= policy.minSamples)
+            {
+                auto delay = latency.Percentile(policy.percentile);
+                return delay.count() > 0 ? delay : std::chrono::microseconds(1);
+            }
+        }
+
+        return policy.delay;
+    }
+
+    HedgePolicy policy;
+    PipedProcess::WindowMode windowMode = { PipedProcess::WindowMode::Hidden };
+
+    std::vector<std::unique_ptr<Attempt>> attempts; // attempts of the last run (the losers are moved out when it ends)
+    unsigned winningAttempt{ 0 };
+
+    std::string stdInBytes;
+    std::string stdOutBytes;
+    std::string stdErrBytes;
+    PipedProcess::RunStatistics runStatistics;
+};
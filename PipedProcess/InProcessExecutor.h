@@ -0,0 +1,268 @@
+// This file is part of the PipedProcess project.
+// See LICENSE file for further information
+// https://github.com/fmuecke/PipedProcess
+
+// In-process execution of commands that are also available as linkable functions.
+// A command registered in the InProcessRegistry is run on a pooled thread instead of a child process
+// if the PipedProcess is set to ExecutionMode::InProcess (see PipedProcess::SetExecutionMode).
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Output stream (stdout or stderr) of an in-process command
+class OutputSink
+{
+public:
+    explicit OutputSink(std::atomic<bool> const& abortFlag) : abortFlag(abortFlag)
+    {}
+
+    // Writes after an abort are dropped, as the output of an aborted run is discarded
+    void Write(const char* pData, size_t len)
+    {
+        if (!IsAborted())
+        {
+            data.append(pData, len);
+            if (onWrite)
+            {
+                onWrite(len);
+            }
+        }
+    }
+
+    void Write(std::string_view text) { Write(text.data(), text.size()); }
+
+    // Set a function that is called with the size of every write (set before the command runs)
+    void SetWriteObserver(std::function<void(size_t)> observer) { onWrite = std::move(observer); }
+
+    // Returns true if the run has been aborted
+    // Long running commands should check this regularly and return early.
+    bool IsAborted() const { return abortFlag.load(std::memory_order_relaxed); }
+
+    std::string& Data() { return data; }
+
+    OutputSink(const OutputSink&) = delete; // non-copyable
+    OutputSink& operator=(const OutputSink&) = delete; // non-assignable
+
+private:
+    std::atomic<bool> const& abortFlag;
+    std::string data;
+    std::function<void(size_t)> onWrite;
+};
+
+// A command gets its arguments and stdin data and returns its exit code
+// Commands may be called concurrently from several threads.
+using InProcessCommand = std::function<int(std::string_view arguments, std::string_view stdIn, OutputSink& stdOut, OutputSink& stdErr)>;
+
+// Registry of the commands that can be run in-process, keyed by program name
+class InProcessRegistry
+{
+public:
+    // The registry used by PipedProcess::Run
+    static InProcessRegistry& Global()
+    {
+        static InProcessRegistry instance;
+        return instance;
+    }
+
+    // Register a command for the specified program (as passed to PipedProcess::Run)
+    void Register(std::string const& program, InProcessCommand command)
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        commands[program] = std::make_shared<const InProcessCommand>(std::move(command));
+    }
+
+    void Unregister(std::string const& program)
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        commands.erase(program);
+    }
+
+    // Returns the command registered for the specified program or nullptr
+    // Runs without a program (command line only) are never run in-process.
+    std::shared_ptr<const InProcessCommand> Find(const char* program) const
+    {
+        if (!program)
+        {
+            return nullptr;
+        }
+
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = commands.find(program);
+        return it != commands.end() ? it->second : nullptr;
+    }
+
+private:
+    mutable std::shared_mutex mutex;
+    std::map<std::string, std::shared_ptr<const InProcessCommand>, std::less<>> commands;
+};
+
+// Fixed size pool of threads that run the in-process commands
+// A worker that is stuck in an abandoned job is replaced, so commands that ignore an abort
+// do not reduce the pool, and the destructor does not wait for them.
+class InProcessThreadPool
+{
+public:
+    // A submitted task
+    class Job
+    {
+    private:
+        friend class InProcessThreadPool;
+
+        enum class State { Queued, Running, Finished, Abandoned };
+
+        std::packaged_task<void()> task;
+        std::atomic<State> state{ State::Queued };
+        std::thread::id worker; // set when the job is started
+    };
+
+    // The pool used by PipedProcess::Run (one thread per hardware thread)
+    static InProcessThreadPool& Global()
+    {
+        static InProcessThreadPool instance(std::thread::hardware_concurrency());
+        return instance;
+    }
+
+    explicit InProcessThreadPool(unsigned threadCount)
+    {
+        if (threadCount == 0)
+        {
+            threadCount = 1;
+        }
+
+        for (unsigned i = 0; i < threadCount; ++i)
+        {
+            threads.emplace_back([this]() { Work(); });
+        }
+    }
+
+    ~InProcessThreadPool()
+    {
+        std::vector<std::thread> workers;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            workers.swap(threads);
+        }
+        wakeUp.notify_all();
+
+        for (auto& thread : workers)
+        {
+            thread.join();
+        }
+    }
+
+    InProcessThreadPool(const InProcessThreadPool&) = delete; // non-copyable
+    InProcessThreadPool& operator=(const InProcessThreadPool&) = delete; // non-assignable
+
+    // Queue a task; the returned future becomes ready when the task has been run
+    // If pJob is specified it receives the job, which can be passed to Abandon.
+    std::future<void> Submit(std::function<void()> task, std::shared_ptr<Job>* pJob = nullptr)
+    {
+        auto job = std::make_shared<Job>();
+        job->task = std::packaged_task<void()>(std::move(task));
+        auto result = job->task.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push(job);
+        }
+        wakeUp.notify_one();
+
+        if (pJob)
+        {
+            *pJob = std::move(job);
+        }
+        return result;
+    }
+
+    // Give up on a job whose result is not needed any more (e.g. its run has been aborted)
+    // A queued job is not started. The worker of a running job is detached and replaced;
+    // it ends as soon as the job returns.
+    void Abandon(std::shared_ptr<Job> const& job)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto state = Job::State::Queued;
+        if (job->state.compare_exchange_strong(state, Job::State::Abandoned) ||
+            state != Job::State::Running ||
+            !job->state.compare_exchange_strong(state, Job::State::Abandoned))
+        {
+            return; // not started yet or already finished
+        }
+
+        for (auto it = threads.begin(); it != threads.end(); ++it)
+        {
+            if (it->get_id() == job->worker)
+            {
+                it->detach();
+                threads.erase(it);
+                break;
+            }
+        }
+
+        if (!stopping)
+        {
+            try
+            {
+                threads.emplace_back([this]() { Work(); });
+            }
+            catch (std::system_error&)
+            {
+                // the pool continues with one worker less
+            }
+        }
+    }
+
+private:
+    void Work()
+    {
+        for (;;)
+        {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeUp.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                {
+                    return;
+                }
+                job = std::move(tasks.front());
+                tasks.pop();
+
+                if (job->state != Job::State::Queued)
+                {
+                    continue; // abandoned before it was started
+                }
+                job->state = Job::State::Running;
+                job->worker = std::this_thread::get_id();
+            }
+
+            job->task();
+
+            // the worker of an abandoned job has been replaced and must not touch the pool any more
+            auto state = Job::State::Running;
+            if (!job->state.compare_exchange_strong(state, Job::State::Finished))
+            {
+                return;
+            }
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::queue<std::shared_ptr<Job>> tasks;
+    bool stopping{ false };
+    std::vector<std::thread> threads;
+};
@@ -0,0 +1,199 @@
+// This file is part of the PipedProcess project.
+// See LICENSE file for further information
+// https://github.com/fmuecke/PipedProcess
+
+#pragma once
+
+#include "ByteScan.h"
+#include <string>
+#include <vector>
+
+// This class is used to watch the standard output of a child process while it is read.
+// It matches a byte pattern, any of a set of literals, a number of lines or a number of
+// lines containing a pattern and triggers an action in PipedProcess::Run as soon as the match is found.
+class OutputPredicate
+{
+public:
+    enum class Action
+    {
+        Record = 0,      // only record the match offset
+        Abort = 1,       // terminate the child process (exit code ERROR_PROCESS_ABORTED)
+                         // Only the child itself is terminated: Run still waits for grandchildren
+                         // that inherited its stdout or stderr until they exit.
+        CloseStdOut = 2  // stop reading and close the child's stdout
+    };
+
+    // Matches the first occurrence of the pattern
+    static OutputPredicate Pattern(std::string pattern, Action action)
+    {
+        OutputPredicate predicate(action);
+        predicate.literals.push_back(std::move(pattern));
+        return predicate;
+    }
+
+    // Matches the first occurrence of any of the literals
+    static OutputPredicate AnyOf(std::vector<std::string> literals, Action action)
+    {
+        OutputPredicate predicate(action);
+        predicate.literals = std::move(literals);
+        return predicate;
+    }
+
+    // Matches the end of the specified number of lines (including the delimiter)
+    static OutputPredicate LineCount(size_t lines, Action action, char delimiter = '\n')
+    {
+        OutputPredicate predicate(action);
+        predicate.lineCount = lines;
+        predicate.delimiter = delimiter;
+        return predicate;
+    }
+
+    // Matches the end of the specified number of lines that contain the pattern (including the delimiter)
+    static OutputPredicate MatchingLines(std::string pattern, size_t lines, Action action, char delimiter = '\n')
+    {
+        OutputPredicate predicate(action);
+        predicate.literals.push_back(std::move(pattern));
+        predicate.lineCount = lines;
+        predicate.delimiter = delimiter;
+        predicate.countMatchingLines = true;
+        return predicate;
+    }
+
+    Action GetAction() const { return action; }
+
+    bool IsMatched() const { return matchOffset != ByteScan::npos; }
+
+    // Offset of the match in the output (start of the matched literal or end of the last counted line)
+    size_t MatchOffset() const { return matchOffset; }
+
+    // Index of the matched literal (always 0 for patterns and line counts)
+    size_t MatchIndex() const { return matchIndex; }
+
+    void Reset()
+    {
+        matchOffset = ByteScan::npos;
+        matchIndex = 0;
+        linesSeen = 0;
+        lineStart = 0;
+    }
+
+    // Scans the data that has been appended to the output since the last call
+    // data contains the whole output, newDataOffset is the size of the output at the last call.
+    // Returns true as soon as the predicate matches.
+    bool Scan(const char* data, size_t size, size_t newDataOffset)
+    {
+        if (IsMatched())
+        {
+            return true;
+        }
+
+        if (literals.empty())
+        {
+            return ScanLines(data, size, newDataOffset);
+        }
+        if (countMatchingLines)
+        {
+            return ScanMatchingLines(data, size, newDataOffset);
+        }
+
+        for (size_t i = 0; i < literals.size(); ++i)
+        {
+            auto const& literal = literals[i];
+
+            // a literal might straddle the previous and the new data
+            auto start = newDataOffset < literal.size() ? 0 : newDataOffset - literal.size() + 1;
+
+            // with several literals the end is limited to the best match so far
+            auto end = IsMatched() ? (matchOffset + literal.size() < size ? matchOffset + literal.size() : size) : size;
+            if (end <= start)
+            {
+                continue;
+            }
+
+            auto pos = ByteScan::FindPattern(data + start, end - start, literal.data(), literal.size());
+            if (pos != ByteScan::npos && start + pos < matchOffset)
+            {
+                matchOffset = start + pos;
+                matchIndex = i;
+            }
+        }
+
+        return IsMatched();
+    }
+
+private:
+    explicit OutputPredicate(Action action) : action(action)
+    {}
+
+    bool ScanLines(const char* data, size_t size, size_t newDataOffset)
+    {
+        if (lineCount == 0)
+        {
+            matchOffset = 0;
+            return true;
+        }
+
+        auto pNew = data + newDataOffset;
+        auto newSize = size - newDataOffset;
+
+        // count whole chunks first and only locate the line end in the chunk that completes the count
+        auto lines = ByteScan::CountByte(pNew, newSize, delimiter);
+        if (linesSeen + lines < lineCount)
+        {
+            linesSeen += lines;
+            return false;
+        }
+
+        size_t pos{ 0 };
+        for (;;)
+        {
+            pos += ByteScan::FindByte(pNew + pos, newSize - pos, delimiter) + 1;
+            if (++linesSeen == lineCount)
+            {
+                matchOffset = newDataOffset + pos;
+                return true;
+            }
+        }
+    }
+
+    // only complete lines are searched for the pattern; lineStart is the offset of the first incomplete line
+    bool ScanMatchingLines(const char* data, size_t size, size_t newDataOffset)
+    {
+        if (lineCount == 0)
+        {
+            matchOffset = 0;
+            return true;
+        }
+
+        auto const& pattern = literals.front();
+        auto pos = newDataOffset;
+        for (;;)
+        {
+            auto end = ByteScan::FindByte(data + pos, size - pos, delimiter);
+            if (end == ByteScan::npos)
+            {
+                return false;
+            }
+
+            end += pos;
+            if (ByteScan::FindPattern(data + lineStart, end - lineStart, pattern.data(), pattern.size()) != ByteScan::npos
+                && ++linesSeen == lineCount)
+            {
+                matchOffset = end + 1;
+                return true;
+            }
+            lineStart = pos = end + 1;
+        }
+    }
+
+    Action action;
+    std::vector<std::string> literals;
+    size_t lineCount{ 0 };
+    char delimiter{ '\n' };
+    bool countMatchingLines{ false };
+
+    size_t matchOffset{ ByteScan::npos };
+    size_t matchIndex{ 0 };
+    size_t linesSeen{ 0 };
+    size_t lineStart{ 0 };
+};
@@ -4,10 +4,21 @@
 
 #pragma once
 
+#include "AdmissionController.h"
+#include "InProcessExecutor.h"
+#include "OutputPredicate.h"
+#include "ProcessMetrics.h"
+#include "ProcessPlacement.h"
+#include "RecordReader.h"
+#include "ResultCache.h"
 #include "StdPipe.h"
 #include "windows.h"
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <future>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -23,6 +34,14 @@ class PipedProcess
 public:
     enum class WindowMode { Visible = 0, Hidden = 1 };
 
+    // OutOfProcess always creates a child process, InProcess runs programs that are registered
+    // in the InProcessRegistry on a pooled thread and falls back to a child process otherwise
+    enum class ExecutionMode { OutOfProcess = 0, InProcess = 1 };
+
+    // All lets the child inherit every inheritable handle of the parent, StdHandlesOnly
+    // restricts the inheritance to the child's std pipe handles
+    enum class HandleInheritance { All = 0, StdHandlesOnly = 1 };
+
     // This class is used to signal the child process to abort execution
     // Overwrite the IsSet() method to implement the desired behavior
     struct EmptyAbortEvent
@@ -30,6 +49,17 @@ public:
 		bool IsSet() const { return false; }
 	};
 
+    // Statistics of the last run
+    struct RunStatistics
+    {
+        std::chrono::microseconds spawnLatency{ 0 }; // duration of the process creation
+        std::chrono::microseconds runtime{ 0 };      // time from process creation until exit
+        size_t stdInBytes{ 0 };
+        size_t stdOutBytes{ 0 };
+        size_t stdErrBytes{ 0 };
+        ProcessPlacement placement;                  // placement applied to the child process
+    };
+
 	PipedProcess()
 	{}
 
@@ -42,6 +72,93 @@ public:
         windowMode = mode;
     }
 
+    // Set the execution mode (default is out of process)
+    void SetExecutionMode(ExecutionMode mode)
+    {
+        executionMode = mode;
+    }
+
+    // Set which handles are inherited by the child process (default is all)
+    // With StdHandlesOnly children of concurrent runs do not keep each other's pipes open,
+    // but handles the parent made inheritable on purpose are not passed to the child either.
+    void SetHandleInheritance(HandleInheritance inheritance)
+    {
+        handleInheritance = inheritance;
+    }
+
+    // Set the CPU affinity, preferred NUMA node and priority class of the child processes
+    // The placement is not applied to in-process commands.
+    void SetPlacement(ProcessPlacement const& processPlacement)
+    {
+        placement = processPlacement;
+    }
+
+    // Set a predicate that is evaluated on the child's stdout while it is read
+    // Its action is triggered as soon as it matches (see OutputPredicate::Action)
+    void SetOutputPredicate(OutputPredicate predicate)
+    {
+        outputPredicate = std::move(predicate);
+    }
+
+    void ClearOutputPredicate()
+    {
+        outputPredicate.reset();
+    }
+
+    // Get the output predicate to check for a match after the run (nullptr if none is set)
+    OutputPredicate const* GetOutputPredicate() const { return outputPredicate ? &*outputPredicate : nullptr; }
+
+    // Set a handler that gets the child's stdout and stderr split into records while they are read
+    // The handler is called from the reader threads, one record at a time in arrival order.
+    // The output is still available via FetchStdOutData/FetchStdErrData after the run.
+    void SetRecordHandler(RecordDispatcher::Handler handler, char delimiter = '\n', bool withTimestamps = false)
+    {
+        recordDispatcher = std::make_unique<RecordDispatcher>(std::move(handler), delimiter, withTimestamps);
+    }
+
+    void ClearRecordHandler()
+    {
+        recordDispatcher.reset();
+    }
+
+    // Set a cache for the results of the runs (nullptr disables caching)
+    // Only use it for programs whose output depends on nothing but the executable, the arguments,
+    // the stdin data and the environment variables added to the cache. A cached result is returned
+    // without starting the program. Runs with a user token (RunAs) bypass the cache.
+    void SetResultCache(ResultCache* pCache)
+    {
+        pResultCache = pCache;
+    }
+
+    // Returns true if the result of the last run has been taken from the result cache
+    bool IsResultFromCache() const { return resultFromCache; }
+
+    // Returns true if the last run ran to completion: the program exited on its own and its output has been read
+    // (false if it could not be started, was aborted or an error occurred while exchanging its data)
+    bool HasRunCompleted() const { return runCompleted; }
+
+    // Set a controller that has to admit the runs (nullptr disables admission control)
+    // Runs with a higher priority are admitted first. If a run is not admitted within timeoutMs,
+    // Run returns ERROR_TIMEOUT without starting the program. The controller must outlive the runs,
+    // including aborted in-process commands that are still finishing in the background.
+    void SetAdmissionController(AdmissionController* pController, int priority = 0, DWORD timeoutMs = INFINITE)
+    {
+        pAdmissionController = pController;
+        admissionPriority = priority;
+        admissionTimeoutMs = timeoutMs;
+    }
+
+    // Limit the output of a run (stdout and stderr together, 0 = unlimited)
+    // A run that exceeds the limit is ended like an aborted one and Run returns ERROR_PROCESS_ABORTED.
+    // The output read so far is kept, unless an in-process command had to be abandoned.
+    void SetOutputLimit(size_t maxBytes)
+    {
+        outputLimit = maxBytes;
+    }
+
+    // Returns true if the last run was ended because it exceeded the output limit
+    bool HasExceededOutputLimit() const { return outputLimitExceeded; }
+
     // Run a child process with the specified program and arguments
 	DWORD Run(const char* program, const char* arguments)
 	{
@@ -79,6 +196,9 @@ public:
 		stdInBytes.swap(tmp);
 	}
 
+    // Get the statistics of the last run
+    RunStatistics const& GetRunStatistics() const { return runStatistics; }
+
 	bool HasStdOutData() const { return !stdOutBytes.empty(); } // check if there is data available to read on stdout
 	bool HasStdErrData() const { return !stdErrBytes.empty(); } // check if there is data available to read on stderr
 
@@ -87,6 +207,7 @@ public:
 	{
 		std::string ret;
 		ret.swap(stdOutBytes);
+		admission.ReleaseBufferedBytes(ret.size());
 		return ret;
 	}
 
@@ -95,12 +216,14 @@ public:
 	{
 		std::string ret;
 		ret.swap(stdErrBytes);
+		admission.ReleaseBufferedBytes(ret.size());
 		return ret;
 	}
 
 private:
-    
-    // Run a child process with the specified program and arguments 
+    friend class PipedSession; // shares process creation and error formatting
+
+    // Run a child process with the specified program and arguments
     // using the specified user token and abort event
     template<class T>
     DWORD Run(const char* program, const char* arguments, T& abortEvent, HANDLE const* pUserAccessToken)
@@ -110,6 +233,58 @@ private:
         std::vector<char> args(static_cast<int>(len), 0);
         std::copy(arguments, arguments + len, args.begin());
 
+        runStatistics = RunStatistics{};
+        const auto programName = ProcessMetrics::ProgramName(program, arguments);
+        auto& metrics = ProcessMetrics::Global();
+        ProgramMetrics* pMetrics = metrics.IsEnabled() ? &metrics.ForProgram(programName.c_str()) : nullptr;
+
+        if (outputPredicate)
+        {
+            outputPredicate->Reset();
+        }
+        if (recordDispatcher)
+        {
+            recordDispatcher->Reset();
+        }
+
+        // the output of the previous run is replaced, so it no longer counts against the admission budget
+        admission.Release();
+        outputBytes = 0;
+        outputLimitExceeded = false;
+
+        // runs as another user are not cached: the key does not identify the security context
+        runCompleted = false;
+        resultFromCache = false;
+        cacheKey.clear();
+        if (pResultCache && pUserAccessToken == nullptr && pResultCache->MakeKey(program, arguments, stdInBytes, cacheKey))
+        {
+            ResultCache::Result result;
+            if (pResultCache->Find(cacheKey, result))
+            {
+                return RunFromCache(result);
+            }
+        }
+
+        auto command = executionMode == ExecutionMode::InProcess ? InProcessRegistry::Global().Find(program) : nullptr;
+
+        if (pAdmissionController)
+        {
+            auto error = pAdmissionController->Acquire(admission, command ? 0 : AdmissionController::pipeHandlesPerRun,
+                admissionPriority, admissionTimeoutMs, [&abortEvent]() { return abortEvent.IsSet(); });
+            if (error != NO_ERROR)
+            {
+                auto msg = "Error admitting process '" + programName + "': " + GetErrorString(std::error_code(error, std::system_category()));
+                stdErrBytes = { msg.data(), msg.data() + msg.size() };
+                return error;
+            }
+        }
+        AdmissionChildGuard admissionChild(admission); // the buffered output stays accounted until it is fetched
+
+        if (command)
+        {
+            return RunInProcess(std::move(command), arguments, abortEvent, pMetrics);
+        }
+
         try
         {
             // Note: Raymond Chen ("The Old New Thing") has some thoughtful insights about pipes:
@@ -136,48 +311,30 @@ private:
             PROCESS_INFORMATION procInfo = {0};
 
             // Create the child process
-            bool success{ false };
-            if (pUserAccessToken)
-            {
-                success = ::CreateProcessAsUserA(
-                    *pUserAccessToken,
-                    program,          // executable
-                    &args[0],         // argumenst (writable buffer)
-                    NULL,             // process security attributes
-                    NULL,             // primary thread security attributes
-                    TRUE,             // handles are inherited (for std pipes)
-                    0,                // creation flags
-                    NULL,             // use parent's environment
-                    NULL,             // use parent's current directory
-                    &startInfo,       // STARTUPINFO
-                    &procInfo) != 0;  // receives PROCESS_INFORMATION
-            }
-            else
-            {
-                success = ::CreateProcessA(
-                    program,          // executable
-                    &args[0],         // argumenst (writable buffer)
-                    NULL,             // process security attributes
-                    NULL,             // primary thread security attributes
-                    TRUE,             // handles are inherited (for std pipes)
-                    0,                // creation flags
-                    NULL,             // use parent's environment
-                    NULL,             // use parent's current directory
-                    &startInfo,       // STARTUPINFO
-                    &procInfo) != 0;  // receives PROCESS_INFORMATION
-            }
+            const auto childPlacement = placement.Resolve();
+            const auto spawnStart = std::chrono::steady_clock::now();
+            bool success = CreateChildProcess(program, args, startInfo, pUserAccessToken, procInfo, handleInheritance, childPlacement);
+            const auto spawnEnd = std::chrono::steady_clock::now();
+            runStatistics.spawnLatency = std::chrono::duration_cast<std::chrono::microseconds>(spawnEnd - spawnStart);
 
             DWORD exitCode{ ERROR_INVALID_FUNCTION };
             if (!success)
             {
                 exitCode = ::GetLastError();
+                if (pMetrics)
+                {
+                    pMetrics->spawnFailures.Add();
+                }
                 std::error_code code(exitCode, std::system_category());
-                auto msg = std::string("Error creating process '") + program + "': " + GetErrorString(code);
+                auto msg = "Error creating process '" + programName + "': " + GetErrorString(code);
                 stdErrBytes = { msg.data(), msg.data() + msg.size() };
                 return exitCode;
             }
             else
             {
+                ChildCountGuard childCount(pMetrics ? &metrics.Children() : nullptr);
+                runStatistics.placement = childPlacement;
+
                 // close the handles that are only used by the parent
                 stdInPipe.CloseReadHandle();
                 stdOutPipe.CloseWriteHandle();
@@ -193,22 +350,28 @@ private:
                     {
                         auto msg = "Error writing to child's stdin stream: " + GetErrorString(e.code());
                         stdErrBytes = { msg.data(), msg.data() + msg.size() };
+                        RecordRun(pMetrics, spawnEnd, e.code().value());
                         return e.code().value();
                     }
+                    runStatistics.stdInBytes = stdInBytes.size();
                 }
 
                 stdInPipe.CloseWriteHandle();
                 stdInBytes.clear();
             
                 // read asynchronously from child's stdout and stderr
-                auto stdOutReader = std::async(std::launch::async, &StdPipe::Read, &stdOutPipe);
-                auto stdErrReader = std::async(std::launch::async, &StdPipe::Read, &stdErrPipe);
+                std::atomic<bool> stdOutClosedByPredicate{ false };
+                auto stdOutReader = std::async(std::launch::async, [this, &stdOutPipe, &stdOutClosedByPredicate, &procInfo]()
+                {
+                    return ReadStdOut(stdOutPipe, procInfo.hProcess, stdOutClosedByPredicate);
+                });
+                auto stdErrReader = std::async(std::launch::async, [this, &stdErrPipe, &procInfo]() { return ReadStdErr(stdErrPipe, procInfo.hProcess); });
 
                 // check for abort signal or pipe read errors while process is still running
                 while (WAIT_TIMEOUT == ::WaitForSingleObject(procInfo.hProcess, 50))
                 {
                     // If the reader already has a result there must have been an exception --> stop execution
-                    if (stdOutReader.wait_for(std::chrono::seconds(0)) == std::future_status::ready || 
+                    if ((stdOutReader.wait_for(std::chrono::seconds(0)) == std::future_status::ready && !stdOutClosedByPredicate) ||
                         stdErrReader.wait_for(std::chrono::seconds(0)) == std::future_status::ready || 
                         abortEvent.IsSet())
                     {
@@ -218,6 +381,15 @@ private:
                 }
 
                 ::GetExitCodeProcess(procInfo.hProcess, &exitCode);
+                const auto exitTime = std::chrono::steady_clock::now();
+
+                // the readers might still use the process handle to abort the child
+                stdOutReader.wait();
+                stdErrReader.wait();
+                if (outputLimitExceeded)
+                {
+                    exitCode = ERROR_PROCESS_ABORTED; // even if the child exited on its own in the meantime
+                }
                 ::CloseHandle(procInfo.hProcess);
                 ::CloseHandle(procInfo.hThread);
 
@@ -230,6 +402,7 @@ private:
                     auto msg = "Error reading from child's stdout stream: " + GetErrorString(e.code());
                     // exception during read operation will be written to stdERR
                     stdErrBytes = { msg.data(), msg.data() + msg.size() };
+                    RecordRun(pMetrics, spawnEnd, exitCode, exitTime);
                     return e.code().value();
                 }
 
@@ -241,8 +414,20 @@ private:
                 {
                     auto msg = "Error reading from child's stderr stream: " + GetErrorString(e.code());
                     stdErrBytes = { msg.data(), msg.data() + msg.size() };
-                                    return e.code().value();
+                    RecordRun(pMetrics, spawnEnd, exitCode, exitTime);
+                    return e.code().value();
                 }
+
+                if (recordDispatcher)
+                {
+                    recordDispatcher->Finish();
+                }
+
+                runStatistics.stdOutBytes = stdOutBytes.size();
+                runStatistics.stdErrBytes = stdErrBytes.size();
+                RecordRun(pMetrics, spawnEnd, exitCode, exitTime);
+                StoreResult(exitCode);
+                runCompleted = exitCode != ERROR_PROCESS_ABORTED;
             }
 
             return exitCode;
@@ -255,6 +440,422 @@ private:
         }
     }  // all pipe handles will be closed by the std pipe wrapper class
 
+    // Read the child's stdout, split it into records and evaluate the output predicate on every chunk
+    std::string ReadStdOut(StdPipe& stdOutPipe, HANDLE hProcess, std::atomic<bool>& closedByPredicate)
+    {
+        if (!outputPredicate && !recordDispatcher && !admission.IsAdmitted() && outputLimit == 0)
+        {
+            return stdOutPipe.Read();
+        }
+
+        auto data = stdOutPipe.Read([this, hProcess](std::string const& output, size_t newDataOffset)
+        {
+            if (!AddOutputBytes(output.size() - newDataOffset))
+            {
+                ::TerminateProcess(hProcess, ERROR_PROCESS_ABORTED);
+                return false;
+            }
+
+            if (recordDispatcher)
+            {
+                recordDispatcher->OnChunk(OutputRecord::Stream::StdOut, output.data() + newDataOffset, output.size() - newDataOffset);
+            }
+
+            if (!outputPredicate || !outputPredicate->Scan(output.data(), output.size(), newDataOffset))
+            {
+                return true;
+            }
+
+            switch (outputPredicate->GetAction())
+            {
+            case OutputPredicate::Action::Abort:
+                ::TerminateProcess(hProcess, ERROR_PROCESS_ABORTED);
+                return false;
+            case OutputPredicate::Action::CloseStdOut:
+                return false;
+            default:
+                return true;
+            }
+        });
+
+        if (outputPredicate && outputPredicate->IsMatched() && outputPredicate->GetAction() != OutputPredicate::Action::Record)
+        {
+            // the child gets ERROR_NO_DATA/ERROR_BROKEN_PIPE on its next write
+            closedByPredicate = true;
+            stdOutPipe.CloseReadHandle();
+        }
+
+        return data;
+    }
+
+    // Read the child's stderr and split it into records
+    std::string ReadStdErr(StdPipe& stdErrPipe, HANDLE hProcess)
+    {
+        if (!recordDispatcher && !admission.IsAdmitted() && outputLimit == 0)
+        {
+            return stdErrPipe.Read();
+        }
+
+        return stdErrPipe.Read([this, hProcess](std::string const& output, size_t newDataOffset)
+        {
+            if (!AddOutputBytes(output.size() - newDataOffset))
+            {
+                ::TerminateProcess(hProcess, ERROR_PROCESS_ABORTED);
+                return false;
+            }
+
+            if (recordDispatcher)
+            {
+                recordDispatcher->OnChunk(OutputRecord::Stream::StdErr, output.data() + newDataOffset, output.size() - newDataOffset);
+            }
+            return true;
+        });
+    }
+
+    // Account output of the current run; returns false as soon as the run exceeds the output limit
+    bool AddOutputBytes(size_t bytes)
+    {
+        admission.AddBufferedBytes(bytes);
+        if (outputLimit != 0 && outputBytes.fetch_add(bytes) + bytes > outputLimit)
+        {
+            outputLimitExceeded = true;
+            return false;
+        }
+        return true;
+    }
+
+    // Run a registered command on a pooled thread with the same semantics as a child process
+    // An aborted command is abandoned (its output is discarded) and finishes in the background;
+    // it keeps its admission until it has finished.
+    template<class T>
+    DWORD RunInProcess(std::shared_ptr<const InProcessCommand> command, const char* arguments, T& abortEvent, ProgramMetrics* pMetrics)
+    {
+        // shared with the pool thread, as an aborted command may outlive the run
+        struct Task
+        {
+            std::atomic<bool> abort{ false };
+            std::string arguments;
+            std::string stdIn;
+            OutputSink stdOut{ abort };
+            OutputSink stdErr{ abort };
+            DWORD exitCode{ ERROR_INVALID_FUNCTION };
+            std::chrono::steady_clock::time_point started;
+            AdmissionTicket admission;
+            std::optional<ChildCountGuard> childCount; // an abandoned command is counted until it returns
+            std::atomic<size_t> outputBytes{ 0 };
+            std::atomic<bool> outputLimitExceeded{ false };
+        };
+
+        auto task = std::make_shared<Task>();
+        task->admission = std::move(admission);
+        task->arguments = arguments;
+        task->stdIn.swap(stdInBytes);
+        runStatistics.stdInBytes = task->stdIn.size();
+
+        // account the output like the reader threads of a child process; the sinks are owned by the task
+        auto onWrite = [pTask = task.get(), limit = outputLimit](size_t bytes)
+        {
+            pTask->admission.AddBufferedBytes(bytes);
+            if (limit != 0 && pTask->outputBytes.fetch_add(bytes) + bytes > limit)
+            {
+                pTask->outputLimitExceeded = true;
+                pTask->abort = true;
+            }
+        };
+        task->stdOut.SetWriteObserver(onWrite);
+        task->stdErr.SetWriteObserver(onWrite);
+
+        task->childCount.emplace(pMetrics ? &ProcessMetrics::Global().Children() : nullptr);
+        const auto queued = std::chrono::steady_clock::now();
+        task->started = queued;
+
+        auto& pool = InProcessThreadPool::Global();
+        std::shared_ptr<InProcessThreadPool::Job> job;
+        std::future<void> result;
+        try
+        {
+            result = pool.Submit([task, command]()
+            {
+                task->started = std::chrono::steady_clock::now();
+                try
+                {
+                    task->exitCode = static_cast<DWORD>((*command)(task->arguments, task->stdIn, task->stdOut, task->stdErr));
+                }
+                catch (std::exception& e)
+                {
+                    task->stdErr.Write(std::string("Unhandled exception in in-process command: ") + e.what());
+                    task->exitCode = ERROR_UNHANDLED_EXCEPTION;
+                }
+                catch (...)
+                {
+                    task->stdErr.Write("Unhandled exception in in-process command");
+                    task->exitCode = ERROR_UNHANDLED_EXCEPTION;
+                }
+                task->childCount.reset();
+                task->admission.ReleaseChild(); // the output stays accounted until it is fetched
+            }, &job);
+        }
+        catch (std::system_error& e)
+        {
+            auto msg = "Error queuing in-process command: " + GetErrorString(e.code());
+            stdErrBytes = { msg.data(), msg.data() + msg.size() };
+            return e.code().value();
+        }
+
+        // check for abort signal or an exceeded output limit while the command is still running
+        while (result.wait_for(std::chrono::milliseconds(50)) == std::future_status::timeout)
+        {
+            if (abortEvent.IsSet() || task->outputLimitExceeded)
+            {
+                // a command that does not check IsAborted keeps running, but no longer occupies a pool worker
+                task->abort = true;
+                pool.Abandon(job);
+                outputLimitExceeded = task->outputLimitExceeded.load();
+                runStatistics.spawnLatency = std::chrono::microseconds(0);
+                RecordRun(pMetrics, queued, ERROR_PROCESS_ABORTED);
+                return ERROR_PROCESS_ABORTED;
+            }
+        }
+
+        const auto finished = std::chrono::steady_clock::now();
+        runStatistics.spawnLatency = std::chrono::duration_cast<std::chrono::microseconds>(task->started - queued); // time spent in the pool queue
+        admission = std::move(task->admission); // the buffered output is released when it is fetched
+        outputLimitExceeded = task->outputLimitExceeded.load();
+        const DWORD exitCode = outputLimitExceeded ? static_cast<DWORD>(ERROR_PROCESS_ABORTED) : task->exitCode;
+        stdOutBytes.swap(task->stdOut.Data());
+        stdErrBytes.swap(task->stdErr.Data());
+        ScanCapturedOutput();
+        runStatistics.stdOutBytes = stdOutBytes.size();
+        runStatistics.stdErrBytes = stdErrBytes.size();
+        RecordRun(pMetrics, task->started, exitCode, finished);
+        StoreResult(exitCode);
+        runCompleted = exitCode != ERROR_PROCESS_ABORTED;
+
+        return exitCode;
+    }
+
+    // Return a cached result as if the program had been run
+    DWORD RunFromCache(ResultCache::Result& result)
+    {
+        resultFromCache = true;
+        runCompleted = true;
+        runStatistics.stdInBytes = stdInBytes.size();
+        stdInBytes.clear();
+        stdOutBytes.swap(result.stdOut);
+        stdErrBytes.swap(result.stdErr);
+        ScanCapturedOutput();
+        runStatistics.stdOutBytes = stdOutBytes.size();
+        runStatistics.stdErrBytes = stdErrBytes.size();
+
+        return result.exitCode;
+    }
+
+    // Evaluate the output predicate and the record handler on output that is available at once
+    void ScanCapturedOutput()
+    {
+        if (outputPredicate)
+        {
+            outputPredicate->Scan(stdOutBytes.data(), stdOutBytes.size(), 0); // the match is only recorded
+        }
+        if (recordDispatcher)
+        {
+            // the order of stdout and stderr writes is not known
+            recordDispatcher->OnChunk(OutputRecord::Stream::StdOut, stdOutBytes.data(), stdOutBytes.size());
+            recordDispatcher->OnChunk(OutputRecord::Stream::StdErr, stdErrBytes.data(), stdErrBytes.size());
+            recordDispatcher->Finish();
+        }
+    }
+
+    // Store the result of a completed run in the result cache
+    // Aborted runs and runs whose output was cut short by the output predicate are not stored.
+    void StoreResult(DWORD exitCode)
+    {
+        if (!pResultCache || cacheKey.empty() || exitCode == ERROR_PROCESS_ABORTED ||
+            (outputPredicate && outputPredicate->IsMatched() && outputPredicate->GetAction() != OutputPredicate::Action::Record))
+        {
+            return;
+        }
+
+        pResultCache->Store(cacheKey, ResultCache::Result{ exitCode, stdOutBytes, stdErrBytes });
+    }
+
+    // Attribute list for the extended startup info of a child process
+    class ProcThreadAttributeList
+    {
+    public:
+        ProcThreadAttributeList() = default;
+
+        ~ProcThreadAttributeList()
+        {
+            if (pList)
+            {
+                ::DeleteProcThreadAttributeList(pList);
+            }
+        }
+
+        ProcThreadAttributeList(const ProcThreadAttributeList&) = delete; // non-copyable
+        ProcThreadAttributeList& operator=(const ProcThreadAttributeList&) = delete; // non-assignable
+
+        bool Initialize(DWORD attributeCount)
+        {
+            SIZE_T size{ 0 };
+            ::InitializeProcThreadAttributeList(nullptr, attributeCount, 0, &size);
+            buffer.resize(size);
+            auto pNewList = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(buffer.data());
+            if (!::InitializeProcThreadAttributeList(pNewList, attributeCount, 0, &size))
+            {
+                return false;
+            }
+            pList = pNewList;
+            return true;
+        }
+
+        // The value has to stay valid until the process has been created
+        bool Update(DWORD_PTR attribute, void* pValue, SIZE_T size)
+        {
+            return ::UpdateProcThreadAttribute(pList, 0, attribute, pValue, size, nullptr, nullptr) != 0;
+        }
+
+        LPPROC_THREAD_ATTRIBUTE_LIST Get() const { return pList; }
+
+    private:
+        std::vector<char> buffer;
+        LPPROC_THREAD_ATTRIBUTE_LIST pList{ nullptr };
+    };
+
+    // Create the child process with the std handles specified in startInfo,
+    // optionally using the specified user token and placement (resolved, see ProcessPlacement::Resolve)
+    static bool CreateChildProcess(const char* program, std::vector<char>& args, STARTUPINFOA& startInfo, HANDLE const* pUserAccessToken, PROCESS_INFORMATION& procInfo,
+        HandleInheritance inheritance = HandleInheritance::All, ProcessPlacement const& placement = ProcessPlacement())
+    {
+        STARTUPINFOEXA startInfoEx{};
+        startInfoEx.StartupInfo = startInfo;
+        DWORD creationFlags{ PriorityClassFlag(placement.priority) };
+        BOOL inheritHandles{ TRUE };
+
+        if (placement.affinityMask != 0)
+        {
+            // the affinity is set before the main thread starts running
+            creationFlags |= CREATE_SUSPENDED;
+        }
+
+        std::vector<HANDLE> inheritedHandles;
+        if (inheritance == HandleInheritance::StdHandlesOnly)
+        {
+            // the handle list must not contain duplicates
+            for (auto handle : { startInfo.hStdInput, startInfo.hStdOutput, startInfo.hStdError })
+            {
+                if (handle != 0 && handle != INVALID_HANDLE_VALUE &&
+                    std::find(inheritedHandles.begin(), inheritedHandles.end(), handle) == inheritedHandles.end())
+                {
+                    inheritedHandles.push_back(handle);
+                }
+            }
+
+            if (inheritedHandles.empty())
+            {
+                inheritHandles = FALSE;
+            }
+        }
+
+        USHORT preferredNode = static_cast<USHORT>(placement.numaNode);
+        const DWORD attributeCount = (inheritedHandles.empty() ? 0 : 1) + (placement.numaNode >= 0 ? 1 : 0);
+
+        ProcThreadAttributeList attributes;
+        if (attributeCount > 0)
+        {
+            if (!attributes.Initialize(attributeCount) ||
+                (!inheritedHandles.empty() &&
+                    !attributes.Update(PROC_THREAD_ATTRIBUTE_HANDLE_LIST, inheritedHandles.data(), inheritedHandles.size() * sizeof(HANDLE))) ||
+                (placement.numaNode >= 0 &&
+                    !attributes.Update(PROC_THREAD_ATTRIBUTE_PREFERRED_NODE, &preferredNode, sizeof(preferredNode))))
+            {
+                return false;
+            }
+
+            startInfoEx.StartupInfo.cb = sizeof(startInfoEx);
+            startInfoEx.lpAttributeList = attributes.Get();
+            creationFlags |= EXTENDED_STARTUPINFO_PRESENT;
+        }
+
+        bool created{ false };
+        if (pUserAccessToken)
+        {
+            created = ::CreateProcessAsUserA(
+                *pUserAccessToken,
+                program,          // executable
+                &args[0],         // argumenst (writable buffer)
+                NULL,             // process security attributes
+                NULL,             // primary thread security attributes
+                inheritHandles,   // handles are inherited (for std pipes)
+                creationFlags,    // creation flags
+                NULL,             // use parent's environment
+                NULL,             // use parent's current directory
+                &startInfoEx.StartupInfo, // STARTUPINFO (or STARTUPINFOEX)
+                &procInfo) != 0;  // receives PROCESS_INFORMATION
+        }
+        else
+        {
+            created = ::CreateProcessA(
+                program,          // executable
+                &args[0],         // argumenst (writable buffer)
+                NULL,             // process security attributes
+                NULL,             // primary thread security attributes
+                inheritHandles,   // handles are inherited (for std pipes)
+                creationFlags,    // creation flags
+                NULL,             // use parent's environment
+                NULL,             // use parent's current directory
+                &startInfoEx.StartupInfo, // STARTUPINFO (or STARTUPINFOEX)
+                &procInfo) != 0;  // receives PROCESS_INFORMATION
+        }
+
+        if (!created || placement.affinityMask == 0)
+        {
+            return created;
+        }
+
+        if (!::SetProcessAffinityMask(procInfo.hProcess, placement.affinityMask))
+        {
+            // the child has not run any code yet
+            auto err = ::GetLastError();
+            ::TerminateProcess(procInfo.hProcess, ERROR_PROCESS_ABORTED);
+            ::CloseHandle(procInfo.hProcess);
+            ::CloseHandle(procInfo.hThread);
+            ::SetLastError(err);
+            return false;
+        }
+
+        ::ResumeThread(procInfo.hThread);
+        return true;
+    }
+
+    // Update the run statistics and (if enabled) the process-wide metrics of a started child process
+    void RecordRun(ProgramMetrics* pMetrics, std::chrono::steady_clock::time_point started, DWORD exitCode,
+        std::chrono::steady_clock::time_point exited = std::chrono::steady_clock::now())
+    {
+        runStatistics.runtime = std::chrono::duration_cast<std::chrono::microseconds>(exited - started);
+
+        if (!pMetrics)
+        {
+            return;
+        }
+
+        pMetrics->runs.Add();
+        pMetrics->spawnLatency.Record(runStatistics.spawnLatency);
+        pMetrics->runtime.Record(runStatistics.runtime);
+        pMetrics->stdInBytes.Add(static_cast<int64_t>(runStatistics.stdInBytes));
+        pMetrics->stdOutBytes.Add(static_cast<int64_t>(runStatistics.stdOutBytes));
+        pMetrics->stdErrBytes.Add(static_cast<int64_t>(runStatistics.stdErrBytes));
+        if (exitCode != NO_ERROR)
+        {
+            pMetrics->nonZeroExits.Add();
+        }
+        if (exitCode == ERROR_PROCESS_ABORTED)
+        {
+            pMetrics->aborts.Add();
+        }
+    }
+
     // Set the window flags for the child process (e.g. hidden or visible)
     static void SetWindowFlags(STARTUPINFOA& startInfo, WindowMode mode)
     {
@@ -299,8 +900,25 @@ private:
     std::string stdInBytes;
 	std::string stdOutBytes;
 	std::string stdErrBytes;
+    RunStatistics runStatistics;
 
     WindowMode windowMode = { WindowMode::Hidden };
+    ExecutionMode executionMode = { ExecutionMode::OutOfProcess };
+    HandleInheritance handleInheritance = { HandleInheritance::All };
+    ProcessPlacement placement;
+    std::optional<OutputPredicate> outputPredicate;
+    std::unique_ptr<RecordDispatcher> recordDispatcher;
+    ResultCache* pResultCache{ nullptr };
+    std::string cacheKey; // key of the current run (empty if it is not cached)
+    bool resultFromCache{ false };
+    bool runCompleted{ false };
+    AdmissionController* pAdmissionController{ nullptr };
+    int admissionPriority{ 0 };
+    DWORD admissionTimeoutMs{ INFINITE };
+    AdmissionTicket admission; // of the last run: holds its buffered output until it is fetched
+    size_t outputLimit{ 0 };
+    std::atomic<size_t> outputBytes{ 0 }; // output of the current run, updated by both reader threads
+    std::atomic<bool> outputLimitExceeded{ false };
 };
 
 
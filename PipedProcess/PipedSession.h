@@ -0,0 +1,430 @@
+// This file is part of the PipedProcess project.
+// See LICENSE file for further information
+// https://github.com/fmuecke/PipedProcess
+
+#pragma once
+
+#include "PipedProcess.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// This class is used to keep a child process alive and to exchange messages
+// with it via its standard input and output streams (e.g. REPL-style tools).
+// Output is read by a stdout and a stderr reader thread with blocking pipe reads. A receiving
+// caller spins briefly and then waits on a condition variable that the reader signals, so a
+// message round trip is not bound to the timer resolution.
+class PipedSession
+{
+public:
+    PipedSession()
+    {}
+
+    // Terminates the child process if it is still running
+    ~PipedSession()
+    {
+        Stop(0);
+    }
+
+    PipedSession(const PipedSession&) = delete; // non-copyable
+    PipedSession& operator=(const PipedSession&) = delete; // non-assignable
+
+    // Set the window mode for the child process (default is hidden)
+    void SetWindowMode(PipedProcess::WindowMode mode)
+    {
+        windowMode = mode;
+    }
+
+    // Start a child process with the specified program and arguments
+    DWORD Start(const char* program, const char* arguments)
+    {
+        return Start(program, arguments, nullptr);
+    }
+
+    // Start a child process with the specified program and arguments using the specified user token
+    DWORD StartAs(const HANDLE& token, const char* program, const char* arguments)
+    {
+        return Start(program, arguments, &token);
+    }
+
+    // Returns true if the child process has been started and not yet stopped
+    bool IsRunning() const { return procInfo.hProcess != nullptr; }
+
+    // Write data to the child process' standard input stream
+    // Note: the call blocks if the child does not consume its input
+    DWORD Send(const char* pData, size_t len)
+    {
+        if (!IsRunning())
+        {
+            return ERROR_BROKEN_PIPE;
+        }
+
+        try
+        {
+            stdInPipe->Write(pData, static_cast<int>(len));
+        }
+        catch (std::system_error& e)
+        {
+            auto msg = "Error writing to child's stdin stream: " + PipedProcess::GetErrorString(e.code());
+            std::lock_guard<std::mutex> lock(mutex);
+            stdErrBytes.append(msg);
+            return e.code().value();
+        }
+
+        return NO_ERROR;
+    }
+
+    // Receive the data written to the child's stdout up to the next delimiter
+    // The delimiter is consumed but not part of the message
+    // Returns NO_ERROR, WAIT_TIMEOUT or ERROR_BROKEN_PIPE if the child closed its stdout
+    DWORD ReceiveUntil(const char* pDelimiter, size_t delimiterLen, std::string& message, DWORD timeoutMs)
+    {
+        if (0 == delimiterLen)
+        {
+            return ERROR_INVALID_PARAMETER;
+        }
+
+        const auto deadline = GetDeadline(timeoutMs);
+        std::unique_lock<std::mutex> lock(mutex);
+        CompactInbox();
+
+        size_t searchPos = inboxPos;
+        for (;;)
+        {
+            auto pos = inbox.find(pDelimiter, searchPos, delimiterLen);
+            if (pos != std::string::npos)
+            {
+                message.assign(inbox, inboxPos, pos - inboxPos);
+                inboxPos = pos + delimiterLen;
+                return NO_ERROR;
+            }
+
+            // the delimiter might straddle the data still to be received
+            searchPos = inbox.size() - inboxPos < delimiterLen ? inboxPos : inbox.size() - delimiterLen + 1;
+
+            auto result = WaitForData(lock, deadline);
+            if (result != NO_ERROR)
+            {
+                return result;
+            }
+        }
+    }
+
+    // Receive the data written to the child's stdout up to the next delimiter character
+    DWORD ReceiveUntil(char delimiter, std::string& message, DWORD timeoutMs)
+    {
+        return ReceiveUntil(&delimiter, 1, message, timeoutMs);
+    }
+
+    // Receive exactly len bytes written to the child's stdout
+    // Returns NO_ERROR, WAIT_TIMEOUT or ERROR_BROKEN_PIPE if the child closed its stdout
+    DWORD Receive(size_t len, std::string& message, DWORD timeoutMs)
+    {
+        const auto deadline = GetDeadline(timeoutMs);
+        std::unique_lock<std::mutex> lock(mutex);
+        CompactInbox();
+
+        while (inbox.size() - inboxPos < len)
+        {
+            auto result = WaitForData(lock, deadline);
+            if (result != NO_ERROR)
+            {
+                return result;
+            }
+        }
+
+        message.assign(inbox, inboxPos, len);
+        inboxPos += len;
+        return NO_ERROR;
+    }
+
+    // Close the child's stdin and wait for it to exit
+    // The child is terminated if it does not exit within the timeout
+    // Returns the exit code of the child process
+    DWORD Stop(DWORD timeoutMs)
+    {
+        if (!IsRunning())
+        {
+            return exitCode;
+        }
+
+        stdInPipe->CloseWriteHandle();
+
+        // the reader threads keep draining the output, so the child does not block on a full pipe while exiting
+        if (WAIT_TIMEOUT == ::WaitForSingleObject(procInfo.hProcess, timeoutMs))
+        {
+            ::TerminateProcess(procInfo.hProcess, ERROR_PROCESS_ABORTED);
+            ::WaitForSingleObject(procInfo.hProcess, INFINITE);
+        }
+        JoinReaders();
+
+        ::GetExitCodeProcess(procInfo.hProcess, &exitCode);
+        ::CloseHandle(procInfo.hProcess);
+        ::CloseHandle(procInfo.hThread);
+        procInfo = PROCESS_INFORMATION{ 0 };
+
+        ResetPipes();
+
+        return exitCode;
+    }
+
+    // check if there is data available to read on stderr
+    bool HasStdErrData() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !stdErrBytes.empty();
+    }
+
+    // Fetch the data that was written to the child process' standard error stream so far
+    std::string FetchStdErrData()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string ret;
+        ret.swap(stdErrBytes);
+        return ret;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Start a child process with the specified program and arguments
+    // using the specified user token
+    DWORD Start(const char* program, const char* arguments, HANDLE const* pUserAccessToken)
+    {
+        if (IsRunning())
+        {
+            return ERROR_INVALID_FUNCTION;
+        }
+
+        // arguments need to be in a non const array for the API call
+        const auto len = strlen(arguments) + 1;
+        std::vector<char> args(arguments, arguments + len);
+
+        inbox.clear();
+        inboxPos = 0;
+        exitCode = ERROR_INVALID_FUNCTION;
+        readError = NO_ERROR;
+        stdOutOpen = true;
+        stdErrOpen = true;
+
+        try
+        {
+            stdInPipe = std::make_unique<StdPipe>();
+            stdOutPipe = std::make_unique<StdPipe>();
+            stdErrPipe = std::make_unique<StdPipe>();
+        }
+        catch (std::system_error& e)
+        {
+            auto msg = "Error creating std io pipes: " + PipedProcess::GetErrorString(e.code());
+            stdErrBytes = { msg.data(), msg.data() + msg.size() };
+            ResetPipes();
+            return e.code().value();
+        }
+
+        // read (out/err) and write (in) should not be inheritable
+        ::SetHandleInformation(stdOutPipe->GetReadHandle(), HANDLE_FLAG_INHERIT, 0);
+        ::SetHandleInformation(stdErrPipe->GetReadHandle(), HANDLE_FLAG_INHERIT, 0);
+        ::SetHandleInformation(stdInPipe->GetWriteHandle(), HANDLE_FLAG_INHERIT, 0);
+
+        STARTUPINFOA startInfo{ 0 };
+        startInfo.cb = sizeof(startInfo);
+        startInfo.hStdInput = stdInPipe->GetReadHandle();
+        startInfo.hStdOutput = stdOutPipe->GetWriteHandle();
+        startInfo.hStdError = stdErrPipe->GetWriteHandle();
+        startInfo.dwFlags |= STARTF_USESTDHANDLES; // use the handles specified in hStdInput, hStdOutput, and hStdError
+
+        PipedProcess::SetWindowFlags(startInfo, windowMode);
+
+        if (!PipedProcess::CreateChildProcess(program, args, startInfo, pUserAccessToken, procInfo))
+        {
+            exitCode = ::GetLastError();
+            std::error_code code(exitCode, std::system_category());
+            auto msg = std::string("Error creating process '") + program + "': " + PipedProcess::GetErrorString(code);
+            stdErrBytes = { msg.data(), msg.data() + msg.size() };
+            procInfo = PROCESS_INFORMATION{ 0 };
+            ResetPipes();
+            return exitCode;
+        }
+
+        // close the handles that are only used by the child
+        stdInPipe->CloseReadHandle();
+        stdOutPipe->CloseWriteHandle();
+        stdErrPipe->CloseWriteHandle();
+
+        // stderr is drained as well, otherwise a chatty child could block on it
+        activeReaders = 2;
+        stdOutReader = std::thread([this]() { ReadOutput(*stdOutPipe, inbox, stdOutOpen); });
+        stdErrReader = std::thread([this]() { ReadOutput(*stdErrPipe, stdErrBytes, stdErrOpen); });
+
+        return NO_ERROR;
+    }
+
+    void ResetPipes()
+    {
+        stdInPipe.reset();
+        stdOutPipe.reset();
+        stdErrPipe.reset();
+    }
+
+    static Clock::time_point GetDeadline(DWORD timeoutMs)
+    {
+        if (timeoutMs == INFINITE)
+        {
+            return (Clock::time_point::max)();
+        }
+
+        return Clock::now() + std::chrono::milliseconds(timeoutMs);
+    }
+
+    // Drop the consumed part of the inbox so that it does not grow without bounds
+    void CompactInbox()
+    {
+        if (inboxPos == inbox.size())
+        {
+            inbox.clear();
+            inboxPos = 0;
+        }
+        else if (inboxPos >= readBufferSize)
+        {
+            inbox.erase(0, inboxPos);
+            inboxPos = 0;
+        }
+    }
+
+    // Reader thread: appends the data of a pipe to the target until the write end is closed
+    void ReadOutput(StdPipe& pipe, std::string& target, bool& isOpen)
+    {
+        std::vector<char> buffer(readBufferSize);
+        DWORD error{ NO_ERROR };
+        try
+        {
+            DWORD bytesRead{ 0 };
+            while (pipe.ReadSome(buffer.data(), static_cast<DWORD>(buffer.size()), bytesRead))
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    target.append(buffer.data(), bytesRead);
+                }
+                ++events;
+                dataArrived.notify_all();
+            }
+        }
+        catch (std::system_error& e)
+        {
+            auto msg = "Error reading from child's std io streams: " + PipedProcess::GetErrorString(e.code());
+            std::lock_guard<std::mutex> lock(mutex);
+            stdErrBytes.append(msg);
+            error = e.code().value();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            isOpen = false;
+            if (error != NO_ERROR)
+            {
+                readError = error;
+            }
+        }
+        ++events;
+        dataArrived.notify_all();
+        --activeReaders;
+    }
+
+    // Wait for the reader threads after the child has exited
+    void JoinReaders()
+    {
+        // the write ends might have been inherited by another process that is still running,
+        // so pending reads are cancelled if the readers do not see the end of the pipes soon
+        const auto giveUp = Clock::now() + std::chrono::milliseconds(100);
+        while (activeReaders > 0)
+        {
+            if (Clock::now() >= giveUp)
+            {
+                ::CancelSynchronousIo(stdOutReader.native_handle());
+                ::CancelSynchronousIo(stdErrReader.native_handle());
+            }
+            ::Sleep(1);
+        }
+
+        stdOutReader.join();
+        stdErrReader.join();
+    }
+
+    // Wait until new stdout data arrived, the child closed its stdout or the deadline passed
+    // Spins first to keep the round trip latency low, then blocks until a reader thread signals
+    DWORD WaitForData(std::unique_lock<std::mutex>& lock, Clock::time_point deadline)
+    {
+        const auto received = inbox.size();
+        auto hasChanged = [&]() { return inbox.size() != received || !stdOutOpen || readError != NO_ERROR; };
+
+        if (!hasChanged() && IsRunning())
+        {
+            const auto seenEvents = events.load();
+            lock.unlock();
+            for (unsigned spin = 0; spin < spinCount && events.load() == seenEvents; ++spin)
+            {
+                YieldProcessor();
+            }
+            lock.lock();
+
+            while (!hasChanged())
+            {
+                const auto now = Clock::now();
+                if (now >= deadline)
+                {
+                    return WAIT_TIMEOUT;
+                }
+
+                // wake up regularly to check the child itself, its stdout write handle might have been leaked to another process
+                const auto slice = std::chrono::milliseconds(50);
+                if (!dataArrived.wait_until(lock, deadline - now < slice ? deadline : now + slice, hasChanged) &&
+                    WAIT_OBJECT_0 == ::WaitForSingleObject(procInfo.hProcess, 0))
+                {
+                    // give the reader a moment to pick up the remaining output
+                    dataArrived.wait_for(lock, slice, hasChanged);
+                    break;
+                }
+            }
+        }
+
+        if (inbox.size() != received)
+        {
+            return NO_ERROR;
+        }
+
+        return readError != NO_ERROR ? readError : ERROR_BROKEN_PIPE;
+    }
+
+    static constexpr unsigned spinCount = 2000;
+    static constexpr size_t readBufferSize = 64 * 1024;
+
+    std::unique_ptr<StdPipe> stdInPipe;
+    std::unique_ptr<StdPipe> stdOutPipe;
+    std::unique_ptr<StdPipe> stdErrPipe;
+
+    std::thread stdOutReader;
+    std::thread stdErrReader;
+    std::atomic<int> activeReaders{ 0 };
+    std::atomic<uint64_t> events{ 0 }; // incremented by the readers, lets the caller spin without the lock
+    mutable std::mutex mutex;          // guards the members below while the readers are running
+    std::condition_variable dataArrived;
+
+    bool stdOutOpen{ true };
+    bool stdErrOpen{ true };
+    DWORD readError{ NO_ERROR };
+
+    PROCESS_INFORMATION procInfo{ 0 };
+    DWORD exitCode{ ERROR_INVALID_FUNCTION };
+
+    std::string inbox;     // received stdout data
+    size_t inboxPos{ 0 };  // start of the data not yet received by the caller
+    std::string stdErrBytes;
+
+    PipedProcess::WindowMode windowMode = { PipedProcess::WindowMode::Hidden };
+};
@@ -0,0 +1,462 @@
+// This file is part of the PipedProcess project.
+// See LICENSE file for further information
+// https://github.com/fmuecke/PipedProcess
+
+// Process-wide metrics for all child processes run by PipedProcess.
+// Counters and histograms are sharded over cache lines so that concurrent
+// updates from many threads are lock-free and do not contend with each other.
+// The registry is disabled by default; call ProcessMetrics::Global().Enable(true) to use it.
+
+#pragma once
+
+#include <Windows.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Metrics
+{
+    constexpr size_t shardCount = 8;
+
+    // Returns the shard of the calling thread (assigned round robin on first use)
+    inline size_t ShardIndex()
+    {
+        static std::atomic<size_t> nextShard{ 0 };
+        thread_local const size_t index = nextShard.fetch_add(1, std::memory_order_relaxed) % shardCount;
+        return index;
+    }
+
+    // Returns the index of the highest set bit (v must not be 0)
+    inline unsigned HighestBit(uint64_t v)
+    {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+        unsigned long index{ 0 };
+        _BitScanReverse64(&index, v);
+        return index;
+#elif defined(_MSC_VER)
+        unsigned long index{ 0 };
+        if (_BitScanReverse(&index, static_cast<unsigned long>(v >> 32)))
+        {
+            return index + 32;
+        }
+        _BitScanReverse(&index, static_cast<unsigned long>(v));
+        return index;
+#else
+        return 63 - __builtin_clzll(v);
+#endif
+    }
+}
+
+// Counter (or gauge) that can be updated concurrently without locking
+class ShardedCounter
+{
+public:
+    void Add(int64_t value = 1)
+    {
+        shards[Metrics::ShardIndex()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    int64_t Value() const
+    {
+        int64_t sum{ 0 };
+        for (auto const& shard : shards)
+        {
+            sum += shard.value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+private:
+    struct alignas(64) Shard
+    {
+        std::atomic<int64_t> value{ 0 };
+    };
+
+    std::array<Shard, Metrics::shardCount> shards{};
+};
+
+// Log-linear (HDR-style) histogram of durations in microseconds
+// Every power of two is split into four sub-buckets, i.e. values are recorded with a relative error below 25%.
+class LatencyHistogram
+{
+public:
+    static constexpr unsigned subBucketBits = 2;
+    static constexpr unsigned subBucketCount = 1u << subBucketBits;
+    static constexpr unsigned bucketCount = (64 - subBucketBits + 1) * subBucketCount;
+
+    void Record(std::chrono::microseconds duration)
+    {
+        auto value = static_cast<uint64_t>(duration.count() > 0 ? duration.count() : 0);
+        auto& shard = shards[Metrics::ShardIndex()];
+        shard.counts[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    uint64_t Count() const
+    {
+        uint64_t count{ 0 };
+        for (unsigned i = 0; i < bucketCount; ++i)
+        {
+            count += BucketCount(i);
+        }
+        return count;
+    }
+
+    // Sum of all recorded values in microseconds
+    uint64_t Sum() const
+    {
+        uint64_t sum{ 0 };
+        for (auto const& shard : shards)
+        {
+            sum += shard.sum.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    uint64_t BucketCount(unsigned index) const
+    {
+        uint64_t count{ 0 };
+        for (auto const& shard : shards)
+        {
+            count += shard.counts[index].load(std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+    // Returns the largest value of the bucket that contains the given percentile (0..100)
+    std::chrono::microseconds Percentile(double percentile) const
+    {
+        std::array<uint64_t, bucketCount> counts{};
+        uint64_t total{ 0 };
+        for (unsigned i = 0; i < bucketCount; ++i)
+        {
+            counts[i] = BucketCount(i);
+            total += counts[i];
+        }
+
+        if (total == 0)
+        {
+            return std::chrono::microseconds(0);
+        }
+
+        auto rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(total) + 0.5);
+        rank = rank < 1 ? 1 : (rank > total ? total : rank);
+
+        uint64_t cumulative{ 0 };
+        for (unsigned i = 0; i < bucketCount; ++i)
+        {
+            cumulative += counts[i];
+            if (cumulative >= rank)
+            {
+                return std::chrono::microseconds(static_cast<int64_t>(BucketMaxValue(i)));
+            }
+        }
+
+        return std::chrono::microseconds(0);
+    }
+
+    static unsigned BucketIndex(uint64_t value)
+    {
+        if (value < subBucketCount)
+        {
+            return static_cast<unsigned>(value);
+        }
+
+        auto highestBit = Metrics::HighestBit(value);
+        auto subBucket = static_cast<unsigned>(value >> (highestBit - subBucketBits)) & (subBucketCount - 1);
+        return (highestBit - subBucketBits + 1) * subBucketCount + subBucket;
+    }
+
+    // Largest value that is recorded in the bucket
+    static uint64_t BucketMaxValue(unsigned index)
+    {
+        if (index < subBucketCount)
+        {
+            return index;
+        }
+
+        unsigned shift = index / subBucketCount - 1;
+        uint64_t lowerBound = static_cast<uint64_t>(subBucketCount + index % subBucketCount) << shift;
+        return lowerBound + ((uint64_t{ 1 } << shift) - 1);
+    }
+
+private:
+    struct alignas(64) Shard
+    {
+        std::array<std::atomic<uint64_t>, bucketCount> counts{};
+        std::atomic<uint64_t> sum{ 0 };
+    };
+
+    std::array<Shard, Metrics::shardCount> shards{};
+};
+
+// Counts a running child process for the lifetime of the guard (no-op for a null counter)
+class ChildCountGuard
+{
+public:
+    explicit ChildCountGuard(ShardedCounter* pCounter) : pCounter(pCounter)
+    {
+        if (pCounter)
+        {
+            pCounter->Add(1);
+        }
+    }
+
+    ~ChildCountGuard()
+    {
+        if (pCounter)
+        {
+            pCounter->Add(-1);
+        }
+    }
+
+    ChildCountGuard(const ChildCountGuard&) = delete;
+    ChildCountGuard& operator=(const ChildCountGuard&) = delete;
+
+private:
+    ShardedCounter* pCounter;
+};
+
+// Metrics of all runs of a single program
+struct ProgramMetrics
+{
+    LatencyHistogram spawnLatency;  // duration of the process creation
+    LatencyHistogram runtime;       // time from process creation until exit
+    LatencyHistogram hedgedLatency; // time from the first launch of a HedgedProcess run until its winner exited
+    ShardedCounter runs;
+    ShardedCounter spawnFailures;
+    ShardedCounter nonZeroExits;
+    ShardedCounter aborts;          // runs that ended with ERROR_PROCESS_ABORTED
+    ShardedCounter stdInBytes;
+    ShardedCounter stdOutBytes;
+    ShardedCounter stdErrBytes;
+};
+
+// Registry of the metrics of all programs run by any PipedProcess instance
+class ProcessMetrics
+{
+public:
+    // The process-wide registry that is updated by PipedProcess::Run
+    static ProcessMetrics& Global()
+    {
+        static ProcessMetrics instance;
+        return instance;
+    }
+
+    void Enable(bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+    bool IsEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    // Returns the name under which a run is recorded: the program or, if there is none, the first
+    // token of the command line, which is what CreateProcess runs in that case
+    static std::string ProgramName(const char* program, const char* commandLine)
+    {
+        if (program)
+        {
+            return program;
+        }
+        if (!commandLine)
+        {
+            return {};
+        }
+
+        auto begin = commandLine;
+        while (*begin == ' ' || *begin == '\t')
+        {
+            ++begin;
+        }
+        if (*begin == '"')
+        {
+            auto end = ++begin;
+            while (*end && *end != '"')
+            {
+                ++end;
+            }
+            return std::string(begin, end);
+        }
+
+        auto end = begin;
+        while (*end && *end != ' ' && *end != '\t')
+        {
+            ++end;
+        }
+        return std::string(begin, end);
+    }
+
+    // Returns the metrics of the specified program (created on first use)
+    ProgramMetrics& ForProgram(const char* program)
+    {
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto it = programs.find(program);
+            if (it != programs.end())
+            {
+                return *it->second;
+            }
+        }
+
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        auto& entry = programs[program];
+        if (!entry)
+        {
+            entry = std::make_unique<ProgramMetrics>();
+        }
+        return *entry;
+    }
+
+    // Number of child processes that are currently running
+    ShardedCounter& Children() { return children; }
+    int64_t ChildCount() const { return children.Value(); }
+
+    // Returns all metrics in the Prometheus text exposition format
+    std::string ToPrometheusText() const
+    {
+        std::ostringstream out;
+
+        out << "# HELP pipedprocess_children Number of currently running child processes.\n";
+        out << "# TYPE pipedprocess_children gauge\n";
+        out << "pipedprocess_children " << children.Value() << "\n";
+
+        std::shared_lock<std::shared_mutex> lock(mutex);
+
+        WriteHistograms(out, "pipedprocess_spawn_latency_seconds", "Duration of the child process creation.", &ProgramMetrics::spawnLatency);
+        WriteHistograms(out, "pipedprocess_runtime_seconds", "Time from child process creation until exit.", &ProgramMetrics::runtime);
+        WriteHistograms(out, "pipedprocess_hedged_latency_seconds", "Time from the first launch of a hedged run until its winning child exited.", &ProgramMetrics::hedgedLatency);
+        WriteCounters(out, "pipedprocess_runs_total", "Number of started child processes.", &ProgramMetrics::runs);
+        WriteCounters(out, "pipedprocess_spawn_failures_total", "Number of failed child process creations.", &ProgramMetrics::spawnFailures);
+        WriteCounters(out, "pipedprocess_nonzero_exits_total", "Number of child processes with a non-zero exit code.", &ProgramMetrics::nonZeroExits);
+        WriteCounters(out, "pipedprocess_aborts_total", "Number of aborted child processes.", &ProgramMetrics::aborts);
+
+        out << "# HELP pipedprocess_bytes_total Bytes transferred via the std io streams.\n";
+        out << "# TYPE pipedprocess_bytes_total counter\n";
+        for (auto const& program : programs)
+        {
+            auto label = EscapeLabel(program.first);
+            out << "pipedprocess_bytes_total{program=\"" << label << "\",stream=\"stdin\"} " << program.second->stdInBytes.Value() << "\n";
+            out << "pipedprocess_bytes_total{program=\"" << label << "\",stream=\"stdout\"} " << program.second->stdOutBytes.Value() << "\n";
+            out << "pipedprocess_bytes_total{program=\"" << label << "\",stream=\"stderr\"} " << program.second->stdErrBytes.Value() << "\n";
+        }
+
+        return out.str();
+    }
+
+    // Writes all metrics in the Prometheus text exposition format to the specified file
+    // The file is replaced atomically so that scrapers never see a partial file
+    DWORD WriteToFile(const char* path) const
+    {
+        auto tmpPath = std::string(path) + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            file << ToPrometheusText();
+            if (!file.good())
+            {
+                return ERROR_WRITE_FAULT;
+            }
+        }
+
+        if (!::MoveFileExA(tmpPath.c_str(), path, MOVEFILE_REPLACE_EXISTING))
+        {
+            return ::GetLastError();
+        }
+
+        return NO_ERROR;
+    }
+
+private:
+    void WriteCounters(std::ostringstream& out, const char* name, const char* help, ShardedCounter ProgramMetrics::* counter) const
+    {
+        out << "# HELP " << name << " " << help << "\n";
+        out << "# TYPE " << name << " counter\n";
+        for (auto const& program : programs)
+        {
+            out << name << "{program=\"" << EscapeLabel(program.first) << "\"} " << (program.second.get()->*counter).Value() << "\n";
+        }
+    }
+
+    // Histograms are exported with the same fixed set of buckets for every program and scrape:
+    // one per power of two microseconds up to maxExportedBucket
+    void WriteHistograms(std::ostringstream& out, const char* name, const char* help, LatencyHistogram ProgramMetrics::* histogram) const
+    {
+        out << "# HELP " << name << " " << help << "\n";
+        out << "# TYPE " << name << " histogram\n";
+        for (auto const& program : programs)
+        {
+            auto const& h = program.second.get()->*histogram;
+            auto label = EscapeLabel(program.first);
+
+            // take a snapshot, so that the buckets and the count are consistent while runs are recorded
+            std::array<uint64_t, LatencyHistogram::bucketCount> counts{};
+            uint64_t total{ 0 };
+            for (unsigned i = 0; i < LatencyHistogram::bucketCount; ++i)
+            {
+                counts[i] = h.BucketCount(i);
+                total += counts[i];
+            }
+
+            uint64_t cumulative{ 0 };
+            for (unsigned i = 0; i < LatencyHistogram::bucketCount; ++i)
+            {
+                cumulative += counts[i];
+                auto maxValue = LatencyHistogram::BucketMaxValue(i);
+                if (maxValue > maxExportedBucket)
+                {
+                    break;
+                }
+                if (maxValue != 0 && ((maxValue + 1) & maxValue) == 0) // last bucket below a power of two
+                {
+                    out << name << "_bucket{program=\"" << label << "\",le=\"";
+                    WriteSeconds(out, maxValue);
+                    out << "\"} " << cumulative << "\n";
+                }
+            }
+            out << name << "_bucket{program=\"" << label << "\",le=\"+Inf\"} " << total << "\n";
+            out << name << "_sum{program=\"" << label << "\"} ";
+            WriteSeconds(out, h.Sum());
+            out << "\n";
+            out << name << "_count{program=\"" << label << "\"} " << total << "\n";
+        }
+    }
+
+    // Write microseconds as exact decimal seconds (a double would be rounded by the stream precision)
+    static void WriteSeconds(std::ostringstream& out, uint64_t microseconds)
+    {
+        out << microseconds / 1000000 << "." << std::setw(6) << std::setfill('0') << microseconds % 1000000 << std::setfill(' ');
+    }
+
+    static constexpr uint64_t maxExportedBucket = (uint64_t{ 1 } << 36) - 1; // about 19 hours
+
+    static std::string EscapeLabel(std::string const& value)
+    {
+        std::string result;
+        result.reserve(value.size());
+        for (auto c : value)
+        {
+            switch (c)
+            {
+            case '\\': result += "\\\\"; break;
+            case '"': result += "\\\""; break;
+            case '\n': result += "\\n"; break;
+            default: result += c;
+            }
+        }
+        return result;
+    }
+
+    std::atomic<bool> enabled{ false };
+    ShardedCounter children;
+
+    mutable std::shared_mutex mutex;
+    std::map<std::string, std::unique_ptr<ProgramMetrics>, std::less<>> programs;
+};
@@ -0,0 +1,125 @@
+// This file is part of the PipedProcess project.
+// See LICENSE file for further information
+// https://github.com/fmuecke/PipedProcess
+
+// CPU affinity, NUMA node and priority class of child processes.
+// The placement is applied while the child is created (priority class and preferred node)
+// or before its main thread starts running (affinity mask), see PipedProcess::SetPlacement.
+
+#pragma once
+
+#include <Windows.h>
+#include <atomic>
+#include <vector>
+
+enum class PriorityClass
+{
+    Default = 0, // same as the parent (unless the parent is idle or below normal)
+    Idle = 1,
+    BelowNormal = 2,
+    Normal = 3,
+    AboveNormal = 4,
+    High = 5
+};
+
+// Returns the creation flag of the priority class (0 for the default)
+inline DWORD PriorityClassFlag(PriorityClass priority)
+{
+    switch (priority)
+    {
+    case PriorityClass::Idle: return IDLE_PRIORITY_CLASS;
+    case PriorityClass::BelowNormal: return BELOW_NORMAL_PRIORITY_CLASS;
+    case PriorityClass::Normal: return NORMAL_PRIORITY_CLASS;
+    case PriorityClass::AboveNormal: return ABOVE_NORMAL_PRIORITY_CLASS;
+    case PriorityClass::High: return HIGH_PRIORITY_CLASS;
+    default: return 0;
+    }
+}
+
+// Hands out the processors of a mask round robin, so that the children of a batch
+// are spread over the cores instead of being placed by the scheduler.
+// A spreader can be shared by all processes of a pool. Only processors of the
+// processor group of the parent process can be used.
+class CoreSpreader
+{
+public:
+    // Spread over the processors of the mask (0 for all processors the parent may run on),
+    // each run gets coresPerRun processors
+    explicit CoreSpreader(DWORD_PTR mask = 0, unsigned coresPerRun = 1)
+    {
+        if (mask == 0)
+        {
+            DWORD_PTR systemMask{ 0 };
+            ::GetProcessAffinityMask(::GetCurrentProcess(), &mask, &systemMask);
+        }
+
+        for (unsigned bit = 0; bit < sizeof(DWORD_PTR) * 8; ++bit)
+        {
+            if (mask & (static_cast<DWORD_PTR>(1) << bit))
+            {
+                cores.push_back(bit);
+            }
+        }
+
+        this->coresPerRun = coresPerRun == 0 ? 1 : (coresPerRun > cores.size() ? static_cast<unsigned>(cores.size()) : coresPerRun);
+    }
+
+    CoreSpreader(const CoreSpreader&) = delete; // non-copyable
+    CoreSpreader& operator=(const CoreSpreader&) = delete; // non-assignable
+
+    // Returns the affinity mask of the next run (0 if no processor is available)
+    DWORD_PTR Next()
+    {
+        if (cores.empty())
+        {
+            return 0;
+        }
+
+        const auto first = next.fetch_add(coresPerRun, std::memory_order_relaxed);
+        DWORD_PTR mask{ 0 };
+        for (unsigned i = 0; i < coresPerRun; ++i)
+        {
+            mask |= static_cast<DWORD_PTR>(1) << cores[(first + i) % cores.size()];
+        }
+        return mask;
+    }
+
+    size_t CoreCount() const { return cores.size(); }
+
+private:
+    std::vector<unsigned> cores; // bit indices of the usable processors
+    unsigned coresPerRun{ 1 };
+    std::atomic<size_t> next{ 0 };
+};
+
+// Placement of a child process; the defaults leave the placement to the system
+struct ProcessPlacement
+{
+    DWORD_PTR affinityMask{ 0 };                  // processors the child may run on (0 for no restriction)
+    int numaNode{ -1 };                           // preferred NUMA node (-1 for none)
+    PriorityClass priority{ PriorityClass::Default };
+    CoreSpreader* pSpreader{ nullptr };           // if set, the affinity mask is taken from the spreader for every run
+
+    // Returns the placement of the next run with the affinity mask chosen by the spreader
+    ProcessPlacement Resolve() const
+    {
+        ProcessPlacement resolved = *this;
+        if (pSpreader)
+        {
+            resolved.affinityMask = pSpreader->Next();
+            resolved.pSpreader = nullptr;
+        }
+        return resolved;
+    }
+
+    // Returns the processors of a NUMA node (0 if the node does not exist)
+    static DWORD_PTR NodeMask(int node)
+    {
+        ULONGLONG mask{ 0 };
+        if (node < 0 || !::GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask))
+        {
+            return 0;
+        }
+        return static_cast<DWORD_PTR>(mask);
+    }
+};
@@ -0,0 +1,151 @@
+// This file is part of the PipedProcess project.
+// See LICENSE file for further information
+// https://github.com/fmuecke/PipedProcess
+
+#pragma once
+
+#include "ByteScan.h"
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+// Splits a stream into delimiter separated records while it arrives in chunks.
+// Records are passed as views into the chunk; only a record that straddles chunks
+// is assembled in an internal buffer, whose capacity is reused.
+class RecordSplitter
+{
+public:
+    explicit RecordSplitter(char delimiter = '\n') : delimiter(delimiter)
+    {}
+
+    // Calls onRecord(std::string_view) for every record completed by the chunk (without the delimiter)
+    // The views are only valid during the call.
+    template<class F>
+    void Feed(const char* data, size_t size, F&& onRecord)
+    {
+        size_t pos{ 0 };
+
+        if (!pending.empty())
+        {
+            auto end = ByteScan::FindByte(data, size, delimiter);
+            if (end == ByteScan::npos)
+            {
+                pending.append(data, size);
+                return;
+            }
+
+            pending.append(data, end);
+            onRecord(std::string_view(pending));
+            pending.clear();
+            pos = end + 1;
+        }
+
+        for (;;)
+        {
+            auto end = ByteScan::FindByte(data + pos, size - pos, delimiter);
+            if (end == ByteScan::npos)
+            {
+                break;
+            }
+
+            onRecord(std::string_view(data + pos, end));
+            pos += end + 1;
+        }
+
+        pending.assign(data + pos, size - pos);
+    }
+
+    // Calls onRecord for the last record if it was not terminated by a delimiter
+    template<class F>
+    void Finish(F&& onRecord)
+    {
+        if (!pending.empty())
+        {
+            onRecord(std::string_view(pending));
+            pending.clear();
+        }
+    }
+
+    void Reset() { pending.clear(); }
+
+private:
+    char delimiter;
+    std::string pending; // incomplete record of the previous chunks
+};
+
+// A record of the output of a child process
+struct OutputRecord
+{
+    enum class Stream { StdOut = 1, StdErr = 2 };
+
+    Stream stream;
+    std::string_view data; // only valid during the handler call
+    std::chrono::steady_clock::time_point timestamp; // arrival time of the chunk (if enabled)
+};
+
+// Splits stdout and stderr of a child process into records and passes them to a single handler.
+// Chunks of both streams are processed one at a time, so records are delivered in arrival order.
+class RecordDispatcher
+{
+public:
+    using Handler = std::function<void(OutputRecord const&)>;
+
+    RecordDispatcher(Handler handler, char delimiter, bool withTimestamps)
+        : handler(std::move(handler)), stdOutSplitter(delimiter), stdErrSplitter(delimiter), withTimestamps(withTimestamps)
+    {}
+
+    // Process a chunk that has been read from the specified stream (called from the reader threads)
+    void OnChunk(OutputRecord::Stream stream, const char* data, size_t size)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        OutputRecord record{ stream, {}, {} };
+        if (withTimestamps)
+        {
+            record.timestamp = std::chrono::steady_clock::now();
+        }
+
+        auto& splitter = stream == OutputRecord::Stream::StdOut ? stdOutSplitter : stdErrSplitter;
+        splitter.Feed(data, size, [this, &record](std::string_view recordData)
+        {
+            record.data = recordData;
+            handler(record);
+        });
+    }
+
+    // Pass the unterminated last records of both streams to the handler
+    void Finish()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        OutputRecord record{ OutputRecord::Stream::StdOut, {}, {} };
+        if (withTimestamps)
+        {
+            record.timestamp = std::chrono::steady_clock::now();
+        }
+
+        auto onRecord = [this, &record](std::string_view recordData)
+        {
+            record.data = recordData;
+            handler(record);
+        };
+        stdOutSplitter.Finish(onRecord);
+        record.stream = OutputRecord::Stream::StdErr;
+        stdErrSplitter.Finish(onRecord);
+    }
+
+    void Reset()
+    {
+        stdOutSplitter.Reset();
+        stdErrSplitter.Reset();
+    }
+
+private:
+    std::mutex mutex;
+    Handler handler;
+    RecordSplitter stdOutSplitter;
+    RecordSplitter stdErrSplitter;
+    bool withTimestamps;
+};
@@ -0,0 +1,411 @@
+// This file is part of the PipedProcess project.
+// See LICENSE file for further information
+// https://github.com/fmuecke/PipedProcess
+
+// Content-addressed cache for the results of deterministic programs.
+// A result is keyed by the executable (path, size and last write time), the arguments,
+// selected environment variables and a hash of the stdin data. Results are held in a
+// bounded in-memory LRU list and optionally in a directory that can be shared between
+// processes: every entry is written to a temporary file and moved into place, and read
+// via a read-only file mapping. The oldest entry files are deleted when the directory
+// exceeds its size cap.
+
+#pragma once
+
+#include <Windows.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class ResultCache
+{
+public:
+    struct Result
+    {
+        DWORD exitCode{ NO_ERROR };
+        std::string stdOut;
+        std::string stdErr;
+    };
+
+    // Results are held in memory up to maxMemoryBytes and additionally stored in
+    // the directory if one is specified (it is created if it does not exist)
+    // The entry files in the directory are trimmed to maxDirectoryBytes, oldest first.
+    explicit ResultCache(size_t maxMemoryBytes = 64 * 1024 * 1024, std::string directory = std::string(),
+        uint64_t maxDirectoryBytes = 1024ull * 1024 * 1024)
+        : maxMemoryBytes(maxMemoryBytes), directory(std::move(directory)), maxDirectoryBytes(maxDirectoryBytes)
+    {
+        if (!this->directory.empty())
+        {
+            ::CreateDirectoryA(this->directory.c_str(), nullptr);
+            TrimDirectory();
+        }
+    }
+
+    ResultCache(const ResultCache&) = delete; // non-copyable
+    ResultCache& operator=(const ResultCache&) = delete; // non-assignable
+
+    // Add an environment variable that is part of the key (set before the cache is used)
+    void AddEnvironmentVariable(std::string name)
+    {
+        environmentVariables.push_back(std::move(name));
+    }
+
+    // Build the key of a run; returns false if the executable can not be identified
+    bool MakeKey(const char* program, const char* arguments, std::string_view stdIn, std::string& key) const
+    {
+        WIN32_FILE_ATTRIBUTE_DATA fileInfo{};
+        if (program == nullptr || !::GetFileAttributesExA(program, GetFileExInfoStandard, &fileInfo))
+        {
+            return false;
+        }
+
+        key.clear();
+        key.append(program).push_back('\0');
+        AppendHex(key, (static_cast<uint64_t>(fileInfo.nFileSizeHigh) << 32) | fileInfo.nFileSizeLow);
+        AppendHex(key, (static_cast<uint64_t>(fileInfo.ftLastWriteTime.dwHighDateTime) << 32) | fileInfo.ftLastWriteTime.dwLowDateTime);
+        key.append(arguments).push_back('\0');
+
+        for (auto const& name : environmentVariables)
+        {
+            key.append(name);
+            auto size = ::GetEnvironmentVariableA(name.c_str(), nullptr, 0);
+            if (size != 0) // 0 if the variable is not set
+            {
+                std::string value(size, '\0');
+                size = ::GetEnvironmentVariableA(name.c_str(), &value[0], size);
+                value.resize(size);
+                key.append("=").append(value);
+            }
+            key.push_back('\0');
+        }
+
+        AppendHex(key, Hash(stdIn.data(), stdIn.size()));
+        AppendHex(key, stdIn.size());
+        return true;
+    }
+
+    // Look up the result of a key in memory and then in the directory
+    bool Find(std::string const& key, Result& result)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = index.find(key);
+            if (it != index.end())
+            {
+                entries.splice(entries.begin(), entries, it->second);
+                result = it->second->result;
+                ++hits;
+                return true;
+            }
+        }
+
+        if (!directory.empty() && ReadEntry(key, result))
+        {
+            Insert(key, result);
+            ++hits;
+            return true;
+        }
+
+        ++misses;
+        return false;
+    }
+
+    // Store the result of a key in memory and in the directory
+    void Store(std::string const& key, Result const& result)
+    {
+        Insert(key, result);
+
+        if (!directory.empty())
+        {
+            WriteEntry(key, result);
+        }
+    }
+
+    uint64_t Hits() const { return hits; }
+    uint64_t Misses() const { return misses; }
+
+    // Number of results held in memory
+    size_t Size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    // Fast 64 bit hash (MurmurHash64A) used for stdin data and entry file names
+    static uint64_t Hash(const char* data, size_t size)
+    {
+        const uint64_t m = 0xc6a4a7935bd1e995ull;
+        const int r = 47;
+        uint64_t h = 0x9747b28c ^ (size * m);
+
+        const auto blocks = size / 8;
+        for (size_t i = 0; i < blocks; ++i)
+        {
+            uint64_t k;
+            std::memcpy(&k, data + i * 8, 8);
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+            h ^= k;
+            h *= m;
+        }
+
+        auto tail = reinterpret_cast<const unsigned char*>(data + blocks * 8);
+        switch (size & 7)
+        {
+        case 7: h ^= static_cast<uint64_t>(tail[6]) << 48; // fall through
+        case 6: h ^= static_cast<uint64_t>(tail[5]) << 40; // fall through
+        case 5: h ^= static_cast<uint64_t>(tail[4]) << 32; // fall through
+        case 4: h ^= static_cast<uint64_t>(tail[3]) << 24; // fall through
+        case 3: h ^= static_cast<uint64_t>(tail[2]) << 16; // fall through
+        case 2: h ^= static_cast<uint64_t>(tail[1]) << 8;  // fall through
+        case 1: h ^= static_cast<uint64_t>(tail[0]);
+            h *= m;
+        }
+
+        h ^= h >> r;
+        h *= m;
+        h ^= h >> r;
+        return h;
+    }
+
+private:
+    struct Entry
+    {
+        std::string key;
+        Result result;
+        size_t Bytes() const { return key.size() + result.stdOut.size() + result.stdErr.size(); }
+    };
+
+    // Header of an entry file, followed by the key, stdout and stderr
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t exitCode;
+        uint64_t keySize;
+        uint64_t stdOutSize;
+        uint64_t stdErrSize;
+    };
+
+    static constexpr uint32_t fileMagic = 0x31435250; // "PRC1"
+
+    static void AppendHex(std::string& key, uint64_t value)
+    {
+        const char digits[] = "0123456789abcdef";
+        for (int shift = 60; shift >= 0; shift -= 4)
+        {
+            key.push_back(digits[(value >> shift) & 0xF]);
+        }
+        key.push_back('\0');
+    }
+
+    // Insert or replace a result in memory and evict the least recently used ones
+    void Insert(std::string const& key, Result const& result)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = index.find(key);
+        if (it != index.end())
+        {
+            memoryBytes -= it->second->Bytes();
+            entries.erase(it->second);
+            index.erase(it);
+        }
+
+        Entry entry{ key, result };
+        if (entry.Bytes() > maxMemoryBytes)
+        {
+            return;
+        }
+
+        memoryBytes += entry.Bytes();
+        entries.push_front(std::move(entry));
+        index.emplace(entries.front().key, entries.begin());
+
+        while (memoryBytes > maxMemoryBytes)
+        {
+            auto& last = entries.back();
+            memoryBytes -= last.Bytes();
+            index.erase(last.key);
+            entries.pop_back();
+        }
+    }
+
+    std::string EntryPath(std::string const& key) const
+    {
+        std::string path = directory + "\\";
+        AppendHex(path, Hash(key.data(), key.size()));
+        path.back() = '.'; // replace the terminating 0 of AppendHex
+        return path + "result";
+    }
+
+    // Read an entry file via a file mapping; a missing, truncated or colliding entry is a miss
+    bool ReadEntry(std::string const& key, Result& result) const
+    {
+        auto hFile = ::CreateFileA(EntryPath(key).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (hFile == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        bool found{ false };
+        LARGE_INTEGER fileSize{};
+        if (::GetFileSizeEx(hFile, &fileSize) && static_cast<uint64_t>(fileSize.QuadPart) >= sizeof(FileHeader))
+        {
+            auto hMapping = ::CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (hMapping != nullptr)
+            {
+                auto pView = static_cast<const char*>(::MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+                if (pView != nullptr)
+                {
+                    FileHeader header;
+                    std::memcpy(&header, pView, sizeof(header));
+
+                    // check each size against the bytes that are left, as the sum of the sizes could wrap around
+                    auto remaining = static_cast<uint64_t>(fileSize.QuadPart) - sizeof(header);
+                    bool isValid = header.magic == fileMagic && header.keySize == key.size() && header.keySize <= remaining;
+                    if (isValid)
+                    {
+                        remaining -= header.keySize;
+                        isValid = header.stdOutSize <= remaining;
+                    }
+                    if (isValid)
+                    {
+                        remaining -= header.stdOutSize;
+                        isValid = header.stdErrSize == remaining;
+                    }
+
+                    const auto pKey = pView + sizeof(header);
+                    if (isValid && std::memcmp(pKey, key.data(), key.size()) == 0)
+                    {
+                        const auto pStdOut = pKey + header.keySize;
+                        const auto pStdErr = pStdOut + header.stdOutSize;
+                        result.exitCode = header.exitCode;
+                        result.stdOut.assign(pStdOut, static_cast<size_t>(header.stdOutSize));
+                        result.stdErr.assign(pStdErr, static_cast<size_t>(header.stdErrSize));
+                        found = true;
+                    }
+
+                    ::UnmapViewOfFile(pView);
+                }
+                ::CloseHandle(hMapping);
+            }
+        }
+
+        ::CloseHandle(hFile);
+        return found;
+    }
+
+    // Write an entry file atomically: other processes either see the old or the complete new entry
+    // Errors are ignored, the result is still cached in memory.
+    void WriteEntry(std::string const& key, Result const& result)
+    {
+        static std::atomic<unsigned> tmpCounter{ 0 };
+
+        const auto path = EntryPath(key);
+        const auto tmpPath = path + "." + std::to_string(::GetCurrentProcessId()) + "." + std::to_string(tmpCounter++) + ".tmp";
+
+        FileHeader header{ fileMagic, static_cast<uint32_t>(result.exitCode), key.size(), result.stdOut.size(), result.stdErr.size() };
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(key.data(), key.size());
+            file.write(result.stdOut.data(), result.stdOut.size());
+            file.write(result.stdErr.data(), result.stdErr.size());
+            if (!file.good())
+            {
+                file.close();
+                ::DeleteFileA(tmpPath.c_str());
+                return;
+            }
+        }
+
+        // fails if another process has the entry mapped; its entry has the same content
+        if (!::MoveFileExA(tmpPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+        {
+            ::DeleteFileA(tmpPath.c_str());
+            return;
+        }
+
+        const auto fileBytes = sizeof(header) + key.size() + result.stdOut.size() + result.stdErr.size();
+        if (directoryBytes.fetch_add(fileBytes) + fileBytes > maxDirectoryBytes)
+        {
+            TrimDirectory();
+        }
+    }
+
+    // Delete the oldest entry files until the directory is below 3/4 of its cap
+    // The files of other processes are counted as well, so the byte count is corrected on every trim.
+    void TrimDirectory()
+    {
+        struct EntryFile
+        {
+            uint64_t writeTime;
+            uint64_t bytes;
+            std::string name;
+        };
+
+        std::lock_guard<std::mutex> lock(trimMutex);
+
+        std::vector<EntryFile> files;
+        uint64_t totalBytes{ 0 };
+        WIN32_FIND_DATAA data;
+        auto hFind = ::FindFirstFileA((directory + "\\*.result").c_str(), &data);
+        if (hFind != INVALID_HANDLE_VALUE)
+        {
+            do
+            {
+                EntryFile file{ (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime,
+                    (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow, data.cFileName };
+                totalBytes += file.bytes;
+                files.push_back(std::move(file));
+            } while (::FindNextFileA(hFind, &data));
+            ::FindClose(hFind);
+        }
+
+        if (totalBytes > maxDirectoryBytes)
+        {
+            std::sort(files.begin(), files.end(), [](EntryFile const& a, EntryFile const& b) { return a.writeTime < b.writeTime; });
+
+            const auto targetBytes = maxDirectoryBytes / 4 * 3;
+            for (auto const& file : files)
+            {
+                if (totalBytes <= targetBytes)
+                {
+                    break;
+                }
+                if (::DeleteFileA((directory + "\\" + file.name).c_str()))
+                {
+                    totalBytes -= file.bytes;
+                }
+            }
+        }
+
+        directoryBytes = totalBytes;
+    }
+
+    const size_t maxMemoryBytes;
+    const std::string directory;
+    const uint64_t maxDirectoryBytes;
+    std::vector<std::string> environmentVariables;
+
+    std::mutex trimMutex;
+    std::atomic<uint64_t> directoryBytes{ 0 }; // approximate size of the entry files in the directory
+
+    mutable std::mutex mutex;
+    std::list<Entry> entries; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t memoryBytes{ 0 };
+
+    std::atomic<uint64_t> hits{ 0 };
+    std::atomic<uint64_t> misses{ 0 };
+};
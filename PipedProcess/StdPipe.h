@@ -48,13 +48,19 @@ struct StdPipe
     // Reads data from the pipe and returns it as a string 
     // In order to signal finish reading from the pipe, the child process should close the write handle
 	std::string Read() const
+	{
+        return Read([](std::string const&, size_t) { return true; });
+	}
+
+    // Reads data from the pipe and returns it as a string
+    // onChunk(data, newDataOffset) is called after every chunk with all data read so far and the
+    // offset of the new chunk within it; reading stops early if it returns false
+    template<class F>
+	std::string Read(F&& onChunk) const
 	{
 		std::array<char, 4096> buffer{};
 		std::string result;
 
-		using std::begin;
-		using std::end;
-
         for(;;)
 		{
             DWORD bytesRead{ 0 };
@@ -74,12 +80,36 @@ struct StdPipe
                 break;
             }
 
-			std::move(begin(buffer), begin(buffer) + bytesRead, std::back_inserter(result));
+            const auto newDataOffset = result.size();
+			result.append(buffer.data(), bytesRead);
+            if (!onChunk(static_cast<std::string const&>(result), newDataOffset))
+            {
+                break;
+            }
 		}
 
 	    return result;
 	}
 
+    // Reads at most len bytes, blocks until at least one byte is available
+    // Returns false if the write end has been closed or the read has been cancelled (CancelSynchronousIo)
+    bool ReadSome(char* pBuffer, DWORD len, DWORD& bytesRead) const
+    {
+        bytesRead = 0;
+        if (!::ReadFile(_readHandle, pBuffer, len, &bytesRead, NULL))
+        {
+            auto err = ::GetLastError();
+            if (err != ERROR_BROKEN_PIPE && err != ERROR_OPERATION_ABORTED)
+            {
+                throw std::system_error(err, std::system_category());
+            }
+
+            return false;
+        }
+
+        return bytesRead > 0;
+    }
+
     // Writes data to the pipe
     // To signal finish writing to the pipe, call CloseWriteHandle()
     void Write(const char* pBytes, int len) const
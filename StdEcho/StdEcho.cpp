@@ -23,49 +23,46 @@ int main()
 
     DWORD retCode{ 0 }; 
 
-    // peek the data from stdin
+    // check that stdin is a readable pipe
     DWORD bytesAvailable{ 0 };
     auto success = ::PeekNamedPipe(stdInHandle, nullptr, 0, nullptr, &bytesAvailable, nullptr);
-    if (!success || 0 == bytesAvailable)
-	{
-		DWORD bytesWritten{ 0 };
-		std::string message{ "no data on std input received" };
-		::WriteFile(stdErrHandle, message.c_str(), static_cast<int>(message.length()), &bytesWritten, nullptr);
 
-        retCode = 1;
-	}
-    else
+    // echo everything until the parent closes stdin
+    // (reads block until data arrives, so this also works for interactive sessions)
+    DWORD totalBytes{ 0 };
+    while (success)
     {
+        const DWORD bufferSize{ 4096 };
+        std::string input;
+        input.resize(bufferSize);
 
-        for (;;)
+        // read data from stdin
+        DWORD bytesRead{ 0 };
+        success = ::ReadFile(stdInHandle, &input[0], bufferSize, &bytesRead, nullptr);
+        if (!success || 0 == bytesRead)
         {
-            // if stdInHandle has data
-            const DWORD bufferSize{ 4096 };
-            std::string input;
-            input.resize(bufferSize);
+            break;
+        }
+        totalBytes += bytesRead;
+
+        // write read data to stdout
+        DWORD bytesWritten{ 0 };
+        success = ::WriteFile(stdOutHandle, input.c_str(), bytesRead, &bytesWritten, nullptr);
+    }
 
-            // read data from stdin
-            DWORD bytesRead{ 0 };
-            auto success = ::ReadFile(stdInHandle, &input[0], bufferSize, &bytesRead, nullptr);
-            if (!success || 0 == bytesRead)
-            {
-                break;
-            }
+    if (0 == totalBytes)
+    {
+        DWORD bytesWritten{ 0 };
+        std::string message{ "no data on std input received" };
+        ::WriteFile(stdErrHandle, message.c_str(), static_cast<int>(message.length()), &bytesWritten, nullptr);
 
-            // write read data to stdout
-            DWORD bytesWritten{ 0 };
-            success = ::WriteFile(stdOutHandle, input.c_str(), bytesRead, &bytesWritten, nullptr);
-            if (!success)
-            {
-                break;
-            }
-        }
+        retCode = 1;
     }
 
     ::CloseHandle(stdOutHandle);
     ::CloseHandle(stdInHandle);
     ::CloseHandle(stdErrHandle);
-    
+
     return retCode;
 }
 
@@ -0,0 +1,126 @@
+#include "CppUnitTest.h"
+#include "../PipedProcess/PipedProcess.h"
+#include "TestHelpers.h"
+#include <thread>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace PipedProcessTests
+{
+	TEST_CLASS(AdmissionControllerTests)
+	{
+	public:
+		TEST_METHOD(TryAcquire_ChildBudgetExhausted_TimesOut)
+		{
+			AdmissionController controller(1);
+			AdmissionTicket first;
+			AdmissionTicket second;
+
+			Assert::AreEqual(static_cast<DWORD>(NO_ERROR), controller.TryAcquire(first, AdmissionController::pipeHandlesPerRun));
+			Assert::AreEqual(static_cast<DWORD>(ERROR_TIMEOUT), controller.TryAcquire(second, AdmissionController::pipeHandlesPerRun, 0, 50));
+			Assert::AreEqual(static_cast<uint64_t>(1), controller.Rejected());
+
+			first.Release();
+			Assert::AreEqual(static_cast<DWORD>(NO_ERROR), controller.TryAcquire(second, AdmissionController::pipeHandlesPerRun));
+		}
+
+		TEST_METHOD(TryAcquire_BufferedBytesOverBudget_TimesOut)
+		{
+			AdmissionController controller(0, 0, 1024);
+			AdmissionTicket first;
+			AdmissionTicket second;
+
+			Assert::AreEqual(static_cast<DWORD>(NO_ERROR), controller.TryAcquire(first, 0));
+			first.AddBufferedBytes(2048);
+			Assert::AreEqual(static_cast<DWORD>(ERROR_TIMEOUT), controller.TryAcquire(second, 0));
+
+			first.Release();
+			Assert::AreEqual(static_cast<size_t>(0), controller.BufferedBytes());
+			Assert::AreEqual(static_cast<DWORD>(NO_ERROR), controller.TryAcquire(second, 0));
+		}
+
+		TEST_METHOD(Acquire_WaitingRuns_AreAdmittedByPriority)
+		{
+			AdmissionController controller(1);
+			AdmissionTicket running;
+			controller.TryAcquire(running, 0);
+
+			std::vector<int> order;
+			std::mutex orderMutex;
+			auto wait = [&](int priority)
+			{
+				AdmissionTicket ticket;
+				controller.Acquire(ticket, 0, priority, INFINITE, []() { return false; });
+				std::lock_guard<std::mutex> lock(orderMutex);
+				order.push_back(priority);
+			};
+
+			std::thread low(wait, 1);
+			while (controller.QueueDepth() < 1) { std::this_thread::yield(); }
+			std::thread high(wait, 2);
+			while (controller.QueueDepth() < 2) { std::this_thread::yield(); }
+
+			running.Release();
+			low.join();
+			high.join();
+
+			Assert::AreEqual(static_cast<size_t>(2), order.size());
+			Assert::AreEqual(2, order[0], L"higher priority was not admitted first");
+			Assert::AreEqual(1, order[1]);
+		}
+
+		TEST_METHOD(Run_NotAdmittedWithinTimeout_ReturnsTimeout)
+		{
+			AdmissionController controller(1);
+			AdmissionTicket running;
+			controller.TryAcquire(running, AdmissionController::pipeHandlesPerRun);
+
+			PipedProcess process;
+			process.SetAdmissionController(&controller, 0, 100);
+			DWORD exitCode = process.Run(GetCmdPath().c_str(), "/c echo not started");
+			Assert::AreEqual(static_cast<DWORD>(ERROR_TIMEOUT), exitCode, L"run was not rejected");
+			Assert::IsFalse(process.HasStdOutData(), L"program was started");
+
+			running.Release();
+			exitCode = process.Run(GetCmdPath().c_str(), "/c echo started");
+			Assert::AreEqual(static_cast<DWORD>(0), exitCode, L"exit code is not 0");
+			Assert::AreEqual(static_cast<size_t>(0), controller.RunningChildren(), L"ticket was not released");
+		}
+
+		TEST_METHOD(Run_OutputNotFetched_StaysInBufferedBytes)
+		{
+			AdmissionController controller(1, 0, 1024 * 1024);
+
+			PipedProcess process;
+			process.SetAdmissionController(&controller);
+			DWORD exitCode = process.Run(GetCmdPath().c_str(), "/c echo buffered");
+			Assert::AreEqual(static_cast<DWORD>(0), exitCode, L"exit code is not 0");
+			Assert::AreEqual(static_cast<size_t>(0), controller.RunningChildren(), L"child slot was not released");
+			Assert::IsTrue(controller.BufferedBytes() > 0, L"output was released before it was fetched");
+
+			process.FetchStdOutData();
+			process.FetchStdErrData();
+			Assert::AreEqual(static_cast<size_t>(0), controller.BufferedBytes(), L"fetched output is still accounted");
+		}
+
+		TEST_METHOD(Run_InProcess_AccountsOutputSink)
+		{
+			InProcessRegistry::Global().Register("admissionOutput.exe", [](std::string_view, std::string_view, OutputSink& stdOut, OutputSink&)
+			{
+				stdOut.Write(std::string(100, 'x'));
+				return 0;
+			});
+			AdmissionController controller(1, 0, 1024 * 1024);
+
+			PipedProcess process;
+			process.SetExecutionMode(PipedProcess::ExecutionMode::InProcess);
+			process.SetAdmissionController(&controller);
+			DWORD exitCode = process.Run("admissionOutput.exe", "");
+			Assert::AreEqual(static_cast<DWORD>(0), exitCode, L"exit code is not 0");
+			Assert::AreEqual(static_cast<size_t>(100), controller.BufferedBytes(), L"output of the command is not accounted");
+
+			process.FetchStdOutData();
+			Assert::AreEqual(static_cast<size_t>(0), controller.BufferedBytes(), L"fetched output is still accounted");
+		}
+	};
+}
@@ -0,0 +1,61 @@
+#include "CppUnitTest.h"
+#include "../PipedProcess/ByteScan.h"
+#include <algorithm>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace PipedProcessTests
+{
+	TEST_CLASS(ByteScanTests)
+	{
+	private:
+		// deterministic pseudo random text over a small alphabet to get many partial matches
+		static std::string MakeText(size_t size, unsigned seed)
+		{
+			std::string text(size, 'a');
+			for (auto& c : text)
+			{
+				seed = seed * 1103515245u + 12345u;
+				c = "abc\n"[(seed >> 16) % 4];
+			}
+			return text;
+		}
+
+	public:
+
+		TEST_METHOD(FindByte_MatchesStdFind)
+		{
+			for (unsigned size = 0; size < 200; ++size)
+			{
+				auto text = MakeText(size, size);
+				Assert::AreEqual(text.find('\n'), ByteScan::FindByte(text.data(), text.size(), '\n'));
+				Assert::AreEqual(text.find('x'), ByteScan::FindByte(text.data(), text.size(), 'x'));
+			}
+		}
+
+		TEST_METHOD(CountByte_MatchesStdCount)
+		{
+			for (unsigned size = 0; size < 200; ++size)
+			{
+				auto text = MakeText(size, size);
+				auto expected = static_cast<size_t>(std::count(text.begin(), text.end(), '\n'));
+				Assert::AreEqual(expected, ByteScan::CountByte(text.data(), text.size(), '\n'));
+			}
+		}
+
+		TEST_METHOD(FindPattern_MatchesStdFind)
+		{
+			const char* patterns[] = { "", "a", "ab", "abc", "c\nb", "abca", "\n\n\n" };
+			for (unsigned size = 0; size < 200; ++size)
+			{
+				auto text = MakeText(size, size + 7);
+				for (auto pattern : patterns)
+				{
+					auto len = strlen(pattern);
+					Assert::AreEqual(text.find(pattern), ByteScan::FindPattern(text.data(), text.size(), pattern, len));
+				}
+			}
+		}
+	};
+}
@@ -0,0 +1,115 @@
+#include "CppUnitTest.h"
+#include "../PipedProcess/HedgedProcess.h"
+#include "TestHelpers.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace PipedProcessTests
+{
+	TEST_CLASS(HedgedProcessTests)
+	{
+	public:
+		TEST_METHOD(HedgeLimiter_TryAcquire_RespectsCap)
+		{
+			HedgeLimiter limiter(2);
+			Assert::IsTrue(limiter.TryAcquire());
+			Assert::IsTrue(limiter.TryAcquire());
+			Assert::IsFalse(limiter.TryAcquire(), L"limiter exceeded its cap");
+			limiter.Release();
+			Assert::IsTrue(limiter.TryAcquire(), L"limiter did not accept a released slot");
+			Assert::AreEqual(2u, limiter.InFlight());
+		}
+
+		TEST_METHOD(Run_WithoutDelay_DoesNotHedge)
+		{
+			HedgedProcess process;
+
+			int exitCode = process.Run(GetCmdPath().c_str(), "/c exit 1");
+			Assert::AreEqual(1, exitCode, L"exit code is not 1");
+			Assert::AreEqual(1u, process.AttemptCount(), L"a hedge was launched");
+			Assert::AreEqual(0u, process.WinningAttempt());
+		}
+
+		TEST_METHOD(Run_WithSlowCommand_LaunchesHedge)
+		{
+			HedgedProcess process;
+			HedgePolicy policy;
+			policy.delay = std::chrono::milliseconds(10);
+			policy.maxAttempts = 2;
+			process.SetPolicy(policy);
+
+			int exitCode = process.Run(GetCmdPath().c_str(), "/c ping -n 2 127.0.0.1 >nul & echo done"); // takes about a second
+			Assert::AreEqual(0, exitCode, L"exit code is not 0");
+			Assert::AreEqual(2u, process.AttemptCount(), L"no hedge was launched");
+			Assert::IsTrue(process.WinningAttempt() < 2u, L"winning attempt is out of range");
+			Assert::AreNotEqual(process.FetchStdOutData().find("done"), std::string::npos, L"stdout of the winner is missing");
+		}
+
+		TEST_METHOD(Run_WithExhaustedLimiter_DoesNotHedge)
+		{
+			HedgeLimiter limiter(0);
+			HedgedProcess process;
+			HedgePolicy policy;
+			policy.delay = std::chrono::milliseconds(10);
+			policy.pLimiter = &limiter;
+			process.SetPolicy(policy);
+
+			int exitCode = process.Run(GetCmdPath().c_str(), "/c ping -n 2 127.0.0.1 >nul");
+			Assert::AreEqual(0, exitCode, L"exit code is not 0");
+			Assert::AreEqual(1u, process.AttemptCount(), L"a hedge was launched despite the limiter");
+		}
+
+		TEST_METHOD(Run_WithNonExistentProgram_ReturnsErrorAfterAllAttemptsFailed)
+		{
+			HedgedProcess process;
+			HedgePolicy policy;
+			policy.delay = std::chrono::milliseconds(1);
+			policy.maxAttempts = 3;
+			process.SetPolicy(policy);
+
+			int exitCode = process.Run("nonexistent.exe", "");
+			Assert::AreEqual(2, exitCode, L"exit code is not 2"); // 2 is the error code for ERROR_FILE_NOT_FOUND
+			Assert::AreEqual(0u, process.WinningAttempt(), L"the error is not the one of the initial attempt");
+			Assert::IsTrue(process.HasStdErrData(), L"process has no stderr data");
+		}
+
+		TEST_METHOD(Run_WithoutProgram_RunsCommandLine)
+		{
+			HedgedProcess process;
+
+			int exitCode = process.Run(nullptr, "cmd.exe /c exit 1");
+			Assert::AreEqual(1, exitCode, L"exit code is not 1");
+		}
+
+		TEST_METHOD(Run_WithMetrics_RecordsHedgedLatencyOfWinner)
+		{
+			auto& metrics = ProcessMetrics::Global();
+			metrics.Enable(true);
+			auto& program = metrics.ForProgram(GetCmdPath().c_str());
+			auto hedgedRuns = program.hedgedLatency.Count();
+			auto hedgedMicroseconds = program.hedgedLatency.Sum();
+
+			HedgedProcess process;
+			HedgePolicy policy;
+			policy.delay = std::chrono::milliseconds(10);
+			process.SetPolicy(policy);
+
+			int exitCode = process.Run(GetCmdPath().c_str(), "/c ping -n 2 127.0.0.1 >nul"); // takes about a second
+			Assert::AreEqual(0, exitCode, L"exit code is not 0");
+			Assert::AreEqual(hedgedRuns + 1, program.hedgedLatency.Count(), L"hedged latency was not recorded once");
+			Assert::IsTrue(program.hedgedLatency.Sum() - hedgedMicroseconds >= 500000u, L"hedged latency does not cover the whole run");
+
+			metrics.Enable(false);
+		}
+
+		TEST_METHOD(Run_WithStdInData_PassesDataToWinner)
+		{
+			HedgedProcess process;
+			process.SetStdInData("Hello World!", 12);
+
+			int exitCode = process.Run("stdEcho.exe", "");
+			Assert::AreEqual(0, exitCode, L"exit code is not 0");
+			Assert::AreEqual(std::string("Hello World!"), process.FetchStdOutData(), L"stdout data is not as expected");
+		}
+	};
+}
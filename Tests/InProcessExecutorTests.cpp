@@ -0,0 +1,159 @@
+#include "CppUnitTest.h"
+#include "../PipedProcess/PipedProcess.h"
+#include <atomic>
+#include <cctype>
+#include <thread>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace PipedProcessTests
+{
+	TEST_CLASS(InProcessExecutorTests)
+	{
+	private:
+		struct FlagAbortEvent
+		{
+			std::atomic<bool> flag{ false };
+			bool IsSet() const { return flag; }
+		};
+
+	public:
+		InProcessExecutorTests()
+		{
+			auto& registry = InProcessRegistry::Global();
+			registry.Register("upper.exe", [](std::string_view arguments, std::string_view stdIn, OutputSink& stdOut, OutputSink& stdErr)
+			{
+				std::string result(stdIn);
+				for (auto& c : result)
+				{
+					c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+				}
+				stdOut.Write(result);
+				stdErr.Write(arguments);
+				return 3;
+			});
+			registry.Register("wait.exe", [](std::string_view, std::string_view, OutputSink& stdOut, OutputSink&)
+			{
+				while (!stdOut.IsAborted())
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				return 0;
+			});
+			registry.Register("throw.exe", [](std::string_view, std::string_view, OutputSink&, OutputSink&) -> int
+			{
+				throw std::runtime_error("failure");
+			});
+			registry.Register("chatty.exe", [](std::string_view, std::string_view, OutputSink& stdOut, OutputSink&)
+			{
+				while (!stdOut.IsAborted())
+				{
+					stdOut.Write("chatty\n");
+				}
+				return 0;
+			});
+		}
+
+		TEST_METHOD(Run_InProcess_ReturnsExitCodeAndOutput)
+		{
+			PipedProcess process;
+			process.SetExecutionMode(PipedProcess::ExecutionMode::InProcess);
+			process.SetStdInData("Hello World!", 12);
+
+			int exitCode = process.Run("upper.exe", "-a");
+			Assert::AreEqual(3, exitCode, L"exit code is not 3");
+			Assert::AreEqual(std::string("HELLO WORLD!"), process.FetchStdOutData(), L"stdout data is not as expected");
+			Assert::AreEqual(std::string("-a"), process.FetchStdErrData(), L"stderr data is not as expected");
+		}
+
+		TEST_METHOD(Run_InProcessWithAbortEvent_ReturnsProcessAborted)
+		{
+			PipedProcess process;
+			process.SetExecutionMode(PipedProcess::ExecutionMode::InProcess);
+			FlagAbortEvent abortEvent;
+			std::thread aborter([&abortEvent]() { std::this_thread::sleep_for(std::chrono::milliseconds(100)); abortEvent.flag = true; });
+
+			DWORD exitCode = process.Run("wait.exe", "", abortEvent);
+			aborter.join();
+			Assert::AreEqual(static_cast<DWORD>(ERROR_PROCESS_ABORTED), exitCode, L"exit code is not ERROR_PROCESS_ABORTED");
+		}
+
+		TEST_METHOD(Run_InProcessOverOutputLimit_ReturnsProcessAborted)
+		{
+			PipedProcess process;
+			process.SetExecutionMode(PipedProcess::ExecutionMode::InProcess);
+			process.SetOutputLimit(1000);
+
+			DWORD exitCode = process.Run("chatty.exe", "");
+			Assert::AreEqual(static_cast<DWORD>(ERROR_PROCESS_ABORTED), exitCode, L"exit code is not ERROR_PROCESS_ABORTED");
+			Assert::IsTrue(process.HasExceededOutputLimit(), L"output limit was not reported");
+			Assert::IsTrue(process.FetchStdOutData().size() <= 1000 + 7, L"writes after the limit were kept");
+		}
+
+		TEST_METHOD(Run_InProcessWithException_ReturnsUnhandledException)
+		{
+			PipedProcess process;
+			process.SetExecutionMode(PipedProcess::ExecutionMode::InProcess);
+
+			DWORD exitCode = process.Run("throw.exe", "");
+			Assert::AreEqual(static_cast<DWORD>(ERROR_UNHANDLED_EXCEPTION), exitCode);
+			Assert::AreNotEqual(process.FetchStdErrData().find("failure"), std::string::npos, L"stderr does not contain the exception message");
+		}
+
+		TEST_METHOD(Run_OutOfProcess_IgnoresRegisteredCommand)
+		{
+			PipedProcess process;
+
+			int exitCode = process.Run("upper.exe", ""); // not an existing executable
+			Assert::AreEqual(2, exitCode, L"exit code is not 2"); // 2 is the error code for ERROR_FILE_NOT_FOUND
+		}
+
+		TEST_METHOD(Run_InProcessWithUnregisteredProgram_CreatesChildProcess)
+		{
+			PipedProcess process;
+			process.SetExecutionMode(PipedProcess::ExecutionMode::InProcess);
+			process.SetStdInData("Hello World!", 12);
+
+			int exitCode = process.Run("stdEcho.exe", "");
+			Assert::AreEqual(0, exitCode, L"exit code is not 0");
+			Assert::AreEqual(std::string("Hello World!"), process.FetchStdOutData(), L"stdout data is not as expected");
+		}
+
+		TEST_METHOD(Run_InProcessWithoutProgram_CreatesChildProcess)
+		{
+			PipedProcess process;
+			process.SetExecutionMode(PipedProcess::ExecutionMode::InProcess);
+
+			int exitCode = process.Run(nullptr, "upper.exe"); // the command line is not looked up in the registry
+			Assert::AreEqual(2, exitCode, L"exit code is not 2"); // 2 is the error code for ERROR_FILE_NOT_FOUND
+		}
+
+		TEST_METHOD(ThreadPool_WithAbandonedJob_ReplacesWorker)
+		{
+			// shared with the abandoned job, which may outlive the test
+			auto started = std::make_shared<std::atomic<bool>>(false);
+			auto release = std::make_shared<std::atomic<bool>>(false);
+			{
+				InProcessThreadPool pool(1);
+				std::shared_ptr<InProcessThreadPool::Job> job;
+				pool.Submit([started, release]()
+				{
+					*started = true;
+					while (!*release)
+					{
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					}
+				}, &job);
+				while (!*started)
+				{
+					std::this_thread::yield();
+				}
+				pool.Abandon(job);
+
+				auto next = pool.Submit([]() {});
+				Assert::IsTrue(next.wait_for(std::chrono::seconds(5)) == std::future_status::ready, L"the stuck worker has not been replaced");
+			} // the pool must not wait for the abandoned job
+			*release = true;
+		}
+	};
+}
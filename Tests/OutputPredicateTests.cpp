@@ -0,0 +1,86 @@
+#include "CppUnitTest.h"
+#include "../PipedProcess/PipedProcess.h"
+#include "TestHelpers.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace PipedProcessTests
+{
+	TEST_CLASS(OutputPredicateTests)
+	{
+	public:
+		TEST_METHOD(Pattern_StraddlingChunks_IsMatched)
+		{
+			auto predicate = OutputPredicate::Pattern("MARKER", OutputPredicate::Action::Record);
+			std::string output = "some output MAR";
+			Assert::IsFalse(predicate.Scan(output.data(), output.size(), 0));
+
+			auto offset = output.size();
+			output += "KER and more";
+			Assert::IsTrue(predicate.Scan(output.data(), output.size(), offset), L"pattern across chunks was not matched");
+			Assert::AreEqual(static_cast<size_t>(12), predicate.MatchOffset());
+		}
+
+		TEST_METHOD(AnyOf_WithSeveralLiterals_MatchesFirstOccurrence)
+		{
+			auto predicate = OutputPredicate::AnyOf({ "error", "warning" }, OutputPredicate::Action::Record);
+			std::string output = "a warning and an error";
+			Assert::IsTrue(predicate.Scan(output.data(), output.size(), 0));
+			Assert::AreEqual(static_cast<size_t>(2), predicate.MatchOffset());
+			Assert::AreEqual(static_cast<size_t>(1), predicate.MatchIndex());
+		}
+
+		TEST_METHOD(LineCount_OverSeveralChunks_MatchesEndOfLastLine)
+		{
+			auto predicate = OutputPredicate::LineCount(3, OutputPredicate::Action::Record);
+			std::string output = "one\ntwo";
+			Assert::IsFalse(predicate.Scan(output.data(), output.size(), 0));
+
+			auto offset = output.size();
+			output += "\nthree\nfour\n";
+			Assert::IsTrue(predicate.Scan(output.data(), output.size(), offset));
+			Assert::AreEqual(std::string("one\ntwo\nthree\n"), output.substr(0, predicate.MatchOffset()));
+		}
+
+		TEST_METHOD(MatchingLines_OverSeveralChunks_MatchesEndOfLastMatchingLine)
+		{
+			auto predicate = OutputPredicate::MatchingLines("error", 2, OutputPredicate::Action::Record);
+			std::string output = "ok\nan err";
+			Assert::IsFalse(predicate.Scan(output.data(), output.size(), 0));
+
+			auto offset = output.size();
+			output += "or\nok\nerror again";
+			Assert::IsFalse(predicate.Scan(output.data(), output.size(), offset), L"incomplete line was counted");
+
+			offset = output.size();
+			output += "\nerror three\n";
+			Assert::IsTrue(predicate.Scan(output.data(), output.size(), offset));
+			Assert::AreEqual(std::string("ok\nan error\nok\nerror again\n"), output.substr(0, predicate.MatchOffset()));
+		}
+
+		TEST_METHOD(Run_WithAbortPredicate_TerminatesChild)
+		{
+			PipedProcess process;
+			process.SetOutputPredicate(OutputPredicate::Pattern("MARKER", OutputPredicate::Action::Abort));
+
+			// the loop runs inside cmd.exe: a grandchild would keep the pipes open after the abort
+			auto start = std::chrono::steady_clock::now();
+			DWORD exitCode = process.Run(GetCmdPath().c_str(), "/c echo MARKER& for /l %i in (1,1,1000000000) do @rem");
+			auto elapsed = std::chrono::steady_clock::now() - start;
+			Assert::AreEqual(static_cast<DWORD>(ERROR_PROCESS_ABORTED), exitCode, L"child was not aborted");
+			Assert::IsTrue(process.GetOutputPredicate()->IsMatched(), L"predicate did not match");
+			Assert::IsTrue(elapsed < std::chrono::seconds(5), L"child was not aborted early");
+		}
+
+		TEST_METHOD(Run_WithRecordPredicate_ReturnsFullOutput)
+		{
+			PipedProcess process;
+			process.SetOutputPredicate(OutputPredicate::LineCount(1, OutputPredicate::Action::Record));
+
+			int exitCode = process.Run(GetCmdPath().c_str(), "/c echo first& echo second");
+			Assert::AreEqual(0, exitCode, L"exit code is not 0");
+			Assert::IsTrue(process.GetOutputPredicate()->IsMatched(), L"predicate did not match");
+			Assert::AreNotEqual(std::string::npos, process.FetchStdOutData().find("second"), L"output is incomplete");
+		}
+	};
+}
@@ -1,5 +1,8 @@
 #include "CppUnitTest.h"
 #include "../PipedProcess/PipedProcess.h"
+#include <future>
+#include <thread>
+#include <vector>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -131,6 +134,83 @@ namespace PipedProcessTests
 			std::string data = process.FetchStdErrData();
 			Assert::IsTrue(data.empty(), L"stderr data is not empty");
 		}
+
+		TEST_METHOD(Run_OverOutputLimit_IsAborted)
+		{
+			PipedProcess process;
+			process.SetOutputLimit(1000);
+
+			auto start = std::chrono::steady_clock::now();
+			DWORD exitCode = process.Run(cmdPath.c_str(), "/c for /l %i in (1,1,1000000000) do @echo line %i");
+			auto elapsed = std::chrono::steady_clock::now() - start;
+			Assert::AreEqual(static_cast<DWORD>(ERROR_PROCESS_ABORTED), exitCode, L"run was not aborted");
+			Assert::IsTrue(process.HasExceededOutputLimit(), L"output limit was not reported");
+			Assert::IsTrue(elapsed < std::chrono::seconds(5), L"run was not ended early");
+			Assert::IsTrue(process.FetchStdOutData().size() >= 1000, L"output read so far was discarded");
+		}
+
+		TEST_METHOD(Run_StdHandlesOnly_DoesNotInheritOtherPipes)
+		{
+			// simulates the pipe of a concurrent run, which is inheritable as well
+			StdPipe otherPipe;
+
+			PipedProcess process;
+			process.SetHandleInheritance(PipedProcess::HandleInheritance::StdHandlesOnly);
+			std::promise<void> started;
+			auto childStarted = started.get_future();
+			bool isStarted{ false };
+			process.SetRecordHandler([&started, &isStarted](OutputRecord const& record)
+			{
+				if (!isStarted && record.data.find("started") != std::string_view::npos)
+				{
+					isStarted = true;
+					started.set_value();
+				}
+			});
+			auto run = std::async(std::launch::async, [&process]()
+			{
+				return process.Run(cmdPath.c_str(), "/c echo started& ping -n 4 127.0.0.1 >nul");
+			});
+			Assert::IsTrue(childStarted.wait_for(std::chrono::seconds(10)) == std::future_status::ready, L"the child has not started");
+
+			// the read only returns once all write handles are closed, including inherited ones
+			otherPipe.CloseWriteHandle();
+			const auto start = std::chrono::steady_clock::now();
+			otherPipe.Read();
+			Assert::IsTrue(std::chrono::steady_clock::now() - start < std::chrono::seconds(1), L"the pipe has been inherited by the child");
+
+			Assert::AreEqual(static_cast<DWORD>(0), run.get(), L"exit code is not 0");
+			Assert::AreNotEqual(std::string::npos, process.FetchStdOutData().find("started"), L"output is missing");
+		}
+
+		TEST_METHOD(Run_WithLargeParent_ReportsSpawnLatency)
+		{
+			// median spawn latency of a number of runs with the current parent working set
+			auto measure = [](PipedProcess::HandleInheritance inheritance)
+			{
+				LatencyHistogram spawnLatency;
+				PipedProcess process;
+				process.SetHandleInheritance(inheritance);
+				for (int i = 0; i < 20; ++i)
+				{
+					Assert::AreEqual(0, static_cast<int>(process.Run(cmdPath.c_str(), "/c exit 0")), L"exit code is not 0");
+					spawnLatency.Record(process.GetRunStatistics().spawnLatency);
+				}
+				return spawnLatency.Percentile(50).count();
+			};
+
+			const auto small = measure(PipedProcess::HandleInheritance::All);
+			const auto smallStdHandles = measure(PipedProcess::HandleInheritance::StdHandlesOnly);
+
+			std::vector<char> workingSet(512ull * 1024 * 1024, 1); // 512 MB of touched pages
+			const auto large = measure(PipedProcess::HandleInheritance::All);
+			const auto largeStdHandles = measure(PipedProcess::HandleInheritance::StdHandlesOnly);
+
+			Logger::WriteMessage(("spawn latency p50 (us) with small/512 MB parent: all handles " + std::to_string(small) + "/" + std::to_string(large) +
+				", std handles only " + std::to_string(smallStdHandles) + "/" + std::to_string(largeStdHandles) + "\n").c_str());
+			Assert::IsTrue(large < 2 * small + 1000, L"spawn latency grows with the parent working set");
+			Assert::IsTrue(largeStdHandles < 2 * smallStdHandles + 1000, L"spawn latency grows with the parent working set");
+		}
 	};
 
 	std::string PipedProcessTests::cmdPath;
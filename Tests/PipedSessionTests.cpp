@@ -0,0 +1,120 @@
+#include "CppUnitTest.h"
+#include "../PipedProcess/PipedSession.h"
+#include "../PipedProcess/ProcessMetrics.h"
+#include <chrono>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace PipedProcessTests
+{
+	TEST_CLASS(PipedSessionTests)
+	{
+	private:
+		static constexpr const char* echoPath = "stdEcho.exe"; // echos data from stdin to stdout until stdin is closed
+
+	public:
+
+		TEST_METHOD(Start_WithNonExistentProgram_ReturnsErrorCode2)
+		{
+			PipedSession session;
+
+			int exitCode = session.Start("nonexistent.exe", "");
+			Assert::AreEqual(2, exitCode, L"exit code is not 2"); // 2 is the error code for ERROR_FILE_NOT_FOUND
+			Assert::IsFalse(session.IsRunning(), L"session is running");
+			Assert::IsTrue(session.HasStdErrData(), L"session has no stderr data");
+		}
+
+		TEST_METHOD(Send_WithoutStart_ReturnsBrokenPipe)
+		{
+			PipedSession session;
+
+			Assert::AreEqual(static_cast<DWORD>(ERROR_BROKEN_PIPE), session.Send("ping\n", 5));
+		}
+
+		TEST_METHOD(ReceiveUntil_WithEcho_ReturnsMessages)
+		{
+			PipedSession session;
+			Assert::AreEqual(static_cast<DWORD>(NO_ERROR), session.Start(echoPath, ""));
+
+			std::string message;
+			for (int i = 0; i < 100; ++i)
+			{
+				auto request = "message " + std::to_string(i);
+				Assert::AreEqual(static_cast<DWORD>(NO_ERROR), session.Send((request + "\n").c_str(), request.size() + 1));
+				Assert::AreEqual(static_cast<DWORD>(NO_ERROR), session.ReceiveUntil('\n', message, 5000));
+				Assert::AreEqual(request, message, L"received message is not the same as the sent message");
+			}
+
+			Assert::AreEqual(0ul, session.Stop(5000), L"exit code is not 0");
+		}
+
+		TEST_METHOD(ReceiveUntil_RoundTrip_ReportsLatency)
+		{
+			PipedSession session;
+			Assert::AreEqual(static_cast<DWORD>(NO_ERROR), session.Start(echoPath, ""));
+
+			std::string message;
+			LatencyHistogram latency;
+			for (int i = 0; i < 1000; ++i)
+			{
+				auto start = std::chrono::steady_clock::now();
+				Assert::AreEqual(static_cast<DWORD>(NO_ERROR), session.Send("ping\n", 5));
+				Assert::AreEqual(static_cast<DWORD>(NO_ERROR), session.ReceiveUntil('\n', message, 5000));
+				latency.Record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start));
+			}
+
+			auto p50 = latency.Percentile(50).count();
+			auto p99 = latency.Percentile(99).count();
+			Logger::WriteMessage(("round trip latency: p50 " + std::to_string(p50) + " us, p99 " + std::to_string(p99) + " us\n").c_str());
+			Assert::IsTrue(p50 < 1000, L"median round trip takes a millisecond or more");
+
+			Assert::AreEqual(0ul, session.Stop(5000), L"exit code is not 0");
+		}
+
+		TEST_METHOD(ReceiveUntil_WithMultiByteDelimiter_SplitsMessages)
+		{
+			PipedSession session;
+			Assert::AreEqual(static_cast<DWORD>(NO_ERROR), session.Start(echoPath, ""));
+			session.Send("first<>second<>", 15);
+
+			std::string message;
+			Assert::AreEqual(static_cast<DWORD>(NO_ERROR), session.ReceiveUntil("<>", 2, message, 5000));
+			Assert::AreEqual(std::string("first"), message);
+			Assert::AreEqual(static_cast<DWORD>(NO_ERROR), session.ReceiveUntil("<>", 2, message, 5000));
+			Assert::AreEqual(std::string("second"), message);
+		}
+
+		TEST_METHOD(Receive_WithLength_ReturnsExactBytes)
+		{
+			PipedSession session;
+			Assert::AreEqual(static_cast<DWORD>(NO_ERROR), session.Start(echoPath, ""));
+			session.Send("Hello World!", 12);
+
+			std::string message;
+			Assert::AreEqual(static_cast<DWORD>(NO_ERROR), session.Receive(5, message, 5000));
+			Assert::AreEqual(std::string("Hello"), message);
+			Assert::AreEqual(static_cast<DWORD>(NO_ERROR), session.Receive(7, message, 5000));
+			Assert::AreEqual(std::string(" World!"), message);
+		}
+
+		TEST_METHOD(ReceiveUntil_WithoutData_TimesOut)
+		{
+			PipedSession session;
+			Assert::AreEqual(static_cast<DWORD>(NO_ERROR), session.Start(echoPath, ""));
+
+			std::string message;
+			Assert::AreEqual(static_cast<DWORD>(WAIT_TIMEOUT), session.ReceiveUntil('\n', message, 20));
+			Assert::IsTrue(session.IsRunning(), L"session is not running after a timeout");
+		}
+
+		TEST_METHOD(ReceiveUntil_AfterStop_ReturnsBrokenPipe)
+		{
+			PipedSession session;
+			Assert::AreEqual(static_cast<DWORD>(NO_ERROR), session.Start(echoPath, ""));
+			session.Stop(5000);
+
+			std::string message;
+			Assert::AreEqual(static_cast<DWORD>(ERROR_BROKEN_PIPE), session.ReceiveUntil('\n', message, 20));
+		}
+	};
+}
@@ -0,0 +1,192 @@
+#include "CppUnitTest.h"
+#include "../PipedProcess/PipedProcess.h"
+#include "../PipedProcess/ProcessMetrics.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace PipedProcessTests
+{
+	TEST_CLASS(ProcessMetricsTests)
+	{
+	public:
+
+		TEST_METHOD(ShardedCounter_WithConcurrentUpdates_SumsAllValues)
+		{
+			ShardedCounter counter;
+			std::vector<std::thread> threads;
+			for (int i = 0; i < 8; ++i)
+			{
+				threads.emplace_back([&counter]() { for (int j = 0; j < 10000; ++j) counter.Add(); });
+			}
+			for (auto& t : threads)
+			{
+				t.join();
+			}
+
+			Assert::AreEqual(80000ll, static_cast<long long>(counter.Value()), L"counter value is not the sum of all updates");
+		}
+
+		TEST_METHOD(LatencyHistogram_BucketBounds_CoverAllValues)
+		{
+			for (unsigned i = 1; i < LatencyHistogram::bucketCount; ++i)
+			{
+				Assert::AreEqual(i, LatencyHistogram::BucketIndex(LatencyHistogram::BucketMaxValue(i)), L"max value is not in its bucket");
+				Assert::AreEqual(i, LatencyHistogram::BucketIndex(LatencyHistogram::BucketMaxValue(i - 1) + 1), L"buckets are not contiguous");
+			}
+		}
+
+		TEST_METHOD(LatencyHistogram_Percentile_IsWithinBucketPrecision)
+		{
+			LatencyHistogram histogram;
+			for (int i = 1; i <= 100; ++i)
+			{
+				histogram.Record(std::chrono::milliseconds(i));
+			}
+
+			Assert::AreEqual(100ull, static_cast<unsigned long long>(histogram.Count()));
+			auto p50 = histogram.Percentile(50).count();
+			auto p99 = histogram.Percentile(99).count();
+			Assert::IsTrue(p50 >= 50000 && p50 < 62500, L"p50 is not within 25% of the exact value");
+			Assert::IsTrue(p99 >= 99000 && p99 < 123750, L"p99 is not within 25% of the exact value");
+		}
+
+		TEST_METHOD(ProgramName_WithoutProgram_IsFirstTokenOfCommandLine)
+		{
+			Assert::AreEqual(std::string("tool.exe"), ProcessMetrics::ProgramName("tool.exe", "other.exe /x"));
+			Assert::AreEqual(std::string("other.exe"), ProcessMetrics::ProgramName(nullptr, "  other.exe /x"));
+			Assert::AreEqual(std::string("C:\\Program Files\\other.exe"), ProcessMetrics::ProgramName(nullptr, "\"C:\\Program Files\\other.exe\" /x"));
+			Assert::AreEqual(std::string(), ProcessMetrics::ProgramName(nullptr, nullptr));
+		}
+
+		TEST_METHOD(Run_WithoutProgram_IsRecordedUnderCommandLineProgram)
+		{
+			auto& metrics = ProcessMetrics::Global();
+			metrics.Enable(true);
+			auto& program = metrics.ForProgram("cmd.exe");
+			auto runs = program.runs.Value();
+
+			PipedProcess process;
+			DWORD exitCode = process.Run(nullptr, "cmd.exe /c exit 0");
+			Assert::AreEqual(0ul, exitCode, L"exit code is not 0");
+			Assert::AreEqual(static_cast<long long>(runs) + 1, static_cast<long long>(program.runs.Value()), L"run was not recorded");
+
+			metrics.Enable(false);
+		}
+
+		TEST_METHOD(ToPrometheusText_ContainsProgramSeries)
+		{
+			ProcessMetrics metrics;
+			auto& program = metrics.ForProgram("C:\\tools\\tool.exe");
+			program.runs.Add();
+			program.runtime.Record(std::chrono::microseconds(1000));
+
+			auto text = metrics.ToPrometheusText();
+			Assert::AreNotEqual(text.find("pipedprocess_runs_total{program=\"C:\\\\tools\\\\tool.exe\"} 1"), std::string::npos, L"runs counter is missing");
+			Assert::AreNotEqual(text.find("pipedprocess_runtime_seconds_count{program=\"C:\\\\tools\\\\tool.exe\"} 1"), std::string::npos, L"runtime histogram is missing");
+			Assert::AreNotEqual(text.find("pipedprocess_children 0"), std::string::npos, L"children gauge is missing");
+		}
+
+		TEST_METHOD(ToPrometheusText_EmitsFixedBuckets)
+		{
+			ProcessMetrics metrics;
+			metrics.ForProgram("tool.exe").runtime.Record(std::chrono::microseconds(1000));
+
+			auto text = metrics.ToPrometheusText();
+			Assert::AreNotEqual(text.find("pipedprocess_runtime_seconds_bucket{program=\"tool.exe\",le=\"0.000511\"} 0"), std::string::npos, L"bucket below the value is missing");
+			Assert::AreNotEqual(text.find("pipedprocess_runtime_seconds_bucket{program=\"tool.exe\",le=\"0.001023\"} 1"), std::string::npos, L"bucket of the value is missing");
+			Assert::AreNotEqual(text.find("pipedprocess_runtime_seconds_bucket{program=\"tool.exe\",le=\"68719.476735\"} 1"), std::string::npos, L"last fixed bucket is missing");
+			Assert::AreNotEqual(text.find("pipedprocess_runtime_seconds_sum{program=\"tool.exe\"} 0.001000"), std::string::npos, L"sum is not exact");
+		}
+
+		TEST_METHOD(Run_WithMetricsEnabled_UpdatesGlobalRegistry)
+		{
+			auto& metrics = ProcessMetrics::Global();
+			metrics.Enable(true);
+
+			PipedProcess process;
+			process.SetStdInData("Hello World!", 12);
+			int exitCode = process.Run("stdEcho.exe", "");
+			Assert::AreEqual(0, exitCode, L"exit code is not 0");
+
+			auto& program = metrics.ForProgram("stdEcho.exe");
+			Assert::IsTrue(program.runs.Value() >= 1, L"run was not counted");
+			Assert::IsTrue(program.stdOutBytes.Value() >= 12, L"stdout bytes were not counted");
+			Assert::AreEqual(12ull, static_cast<unsigned long long>(process.GetRunStatistics().stdOutBytes), L"run statistics are wrong");
+			Assert::AreEqual(0ll, static_cast<long long>(metrics.ChildCount()), L"children gauge was not decremented");
+
+			metrics.Enable(false);
+		}
+
+		TEST_METHOD(Run_WithAbort_IsCountedAsAbort)
+		{
+			struct SetAbortEvent
+			{
+				bool IsSet() const { return true; }
+			};
+
+			auto& metrics = ProcessMetrics::Global();
+			metrics.Enable(true);
+			InProcessRegistry::Global().Register("metricsAbort.exe", [](std::string_view, std::string_view, OutputSink& stdOut, OutputSink&)
+			{
+				while (!stdOut.IsAborted())
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				return 0;
+			});
+
+			PipedProcess process;
+			process.SetExecutionMode(PipedProcess::ExecutionMode::InProcess);
+			SetAbortEvent abortEvent;
+			DWORD exitCode = process.Run("metricsAbort.exe", "", abortEvent);
+			Assert::AreEqual(static_cast<DWORD>(ERROR_PROCESS_ABORTED), exitCode, L"exit code is not ERROR_PROCESS_ABORTED");
+
+			auto& program = metrics.ForProgram("metricsAbort.exe");
+			Assert::AreEqual(1ll, static_cast<long long>(program.aborts.Value()), L"abort was not counted");
+			Assert::AreEqual(1ull, static_cast<unsigned long long>(program.runtime.Count()), L"aborted run is not part of the runtime histogram");
+
+			metrics.Enable(false);
+		}
+
+		TEST_METHOD(Run_InProcessAbandoned_IsCountedAsChildUntilCommandReturns)
+		{
+			struct SetAbortEvent
+			{
+				bool IsSet() const { return true; }
+			};
+
+			static std::atomic<bool> release{ false };
+			auto& metrics = ProcessMetrics::Global();
+			metrics.Enable(true);
+			InProcessRegistry::Global().Register("metricsStuck.exe", [](std::string_view, std::string_view, OutputSink&, OutputSink&)
+			{
+				while (!release) // ignores the abort
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				return 0;
+			});
+
+			const auto children = metrics.ChildCount();
+			PipedProcess process;
+			process.SetExecutionMode(PipedProcess::ExecutionMode::InProcess);
+			SetAbortEvent abortEvent;
+			DWORD exitCode = process.Run("metricsStuck.exe", "", abortEvent);
+			Assert::AreEqual(static_cast<DWORD>(ERROR_PROCESS_ABORTED), exitCode, L"exit code is not ERROR_PROCESS_ABORTED");
+			Assert::AreEqual(static_cast<long long>(children) + 1, static_cast<long long>(metrics.ChildCount()), L"abandoned command is not counted");
+
+			release = true;
+			const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+			while (metrics.ChildCount() != children && std::chrono::steady_clock::now() < deadline)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			Assert::AreEqual(static_cast<long long>(children), static_cast<long long>(metrics.ChildCount()), L"returned command is still counted");
+
+			metrics.Enable(false);
+		}
+	};
+}
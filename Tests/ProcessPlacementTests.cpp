@@ -0,0 +1,47 @@
+#include "CppUnitTest.h"
+#include "../PipedProcess/PipedProcess.h"
+#include "TestHelpers.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace PipedProcessTests
+{
+	TEST_CLASS(ProcessPlacementTests)
+	{
+	public:
+		TEST_METHOD(CoreSpreader_Next_CyclesThroughProcessors)
+		{
+			CoreSpreader spreader(0xB); // processors 0, 1 and 3
+			Assert::AreEqual(static_cast<size_t>(3), spreader.CoreCount());
+			Assert::AreEqual(static_cast<DWORD_PTR>(0x1), spreader.Next());
+			Assert::AreEqual(static_cast<DWORD_PTR>(0x2), spreader.Next());
+			Assert::AreEqual(static_cast<DWORD_PTR>(0x8), spreader.Next());
+			Assert::AreEqual(static_cast<DWORD_PTR>(0x1), spreader.Next());
+		}
+
+		TEST_METHOD(CoreSpreader_SeveralCoresPerRun_ReturnsAdjacentProcessors)
+		{
+			CoreSpreader spreader(0xF, 2);
+			Assert::AreEqual(static_cast<DWORD_PTR>(0x3), spreader.Next());
+			Assert::AreEqual(static_cast<DWORD_PTR>(0xC), spreader.Next());
+		}
+
+		TEST_METHOD(Run_WithSpreader_ReportsAppliedPlacement)
+		{
+			CoreSpreader spreader;
+			ProcessPlacement placement;
+			placement.priority = PriorityClass::BelowNormal;
+			placement.pSpreader = &spreader;
+
+			PipedProcess process;
+			process.SetPlacement(placement);
+			int exitCode = process.Run(GetCmdPath().c_str(), "/c echo placed");
+			Assert::AreEqual(0, exitCode, L"exit code is not 0");
+
+			auto const& applied = process.GetRunStatistics().placement;
+			Assert::AreNotEqual(static_cast<DWORD_PTR>(0), applied.affinityMask, L"no affinity mask was applied");
+			Assert::IsTrue(applied.priority == PriorityClass::BelowNormal, L"priority class was not applied");
+			Assert::AreNotEqual(std::string::npos, process.FetchStdOutData().find("placed"), L"output is missing");
+		}
+	};
+}
@@ -0,0 +1,69 @@
+#include "CppUnitTest.h"
+#include "../PipedProcess/PipedProcess.h"
+#include "TestHelpers.h"
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace PipedProcessTests
+{
+	TEST_CLASS(RecordReaderTests)
+	{
+	public:
+		TEST_METHOD(Feed_RecordStraddlingChunks_IsAssembled)
+		{
+			RecordSplitter splitter;
+			std::vector<std::string> records;
+			auto onRecord = [&records](std::string_view record) { records.emplace_back(record); };
+
+			std::string chunk1 = "one\ntw";
+			std::string chunk2 = "o\nthr";
+			std::string chunk3 = "ee\n";
+			splitter.Feed(chunk1.data(), chunk1.size(), onRecord);
+			splitter.Feed(chunk2.data(), chunk2.size(), onRecord);
+			splitter.Feed(chunk3.data(), chunk3.size(), onRecord);
+
+			Assert::AreEqual(static_cast<size_t>(3), records.size());
+			Assert::AreEqual(std::string("one"), records[0]);
+			Assert::AreEqual(std::string("two"), records[1]);
+			Assert::AreEqual(std::string("three"), records[2]);
+		}
+
+		TEST_METHOD(Finish_UnterminatedLastRecord_IsPassed)
+		{
+			RecordSplitter splitter('\0');
+			std::vector<std::string> records;
+			auto onRecord = [&records](std::string_view record) { records.emplace_back(record); };
+
+			std::string chunk("first\0last", 10);
+			splitter.Feed(chunk.data(), chunk.size(), onRecord);
+			Assert::AreEqual(static_cast<size_t>(1), records.size(), L"unterminated record was passed too early");
+
+			splitter.Finish(onRecord);
+			Assert::AreEqual(static_cast<size_t>(2), records.size());
+			Assert::AreEqual(std::string("last"), records[1]);
+		}
+
+		TEST_METHOD(Run_WithRecordHandler_PassesRecordsOfBothStreams)
+		{
+			std::vector<std::string> stdOutRecords;
+			std::vector<std::string> stdErrRecords;
+
+			PipedProcess process;
+			process.SetRecordHandler([&](OutputRecord const& record)
+			{
+				auto& records = record.stream == OutputRecord::Stream::StdOut ? stdOutRecords : stdErrRecords;
+				records.emplace_back(record.data);
+			});
+
+			int exitCode = process.Run(GetCmdPath().c_str(), "/c echo first& echo second& echo error 1>&2");
+			Assert::AreEqual(0, exitCode, L"exit code is not 0");
+			Assert::AreEqual(static_cast<size_t>(2), stdOutRecords.size());
+			Assert::AreEqual(std::string("first\r"), stdOutRecords[0]);
+			Assert::AreEqual(std::string("second\r"), stdOutRecords[1]);
+			Assert::AreEqual(static_cast<size_t>(1), stdErrRecords.size());
+			Assert::AreEqual(std::string("error \r"), stdErrRecords[0]);
+			Assert::AreNotEqual(std::string::npos, process.FetchStdOutData().find("second"), L"output is not captured anymore");
+		}
+	};
+}
@@ -0,0 +1,122 @@
+#include "CppUnitTest.h"
+#include "../PipedProcess/PipedProcess.h"
+#include "TestHelpers.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace PipedProcessTests
+{
+	TEST_CLASS(ResultCacheTests)
+	{
+	private:
+		// Unique cache directory in %TEMP% that is deleted with its entry files
+		struct TempDirectory
+		{
+			explicit TempDirectory(const char* name)
+			{
+				char tmpPath[MAX_PATH];
+				::GetTempPathA(MAX_PATH, tmpPath);
+				path = std::string(tmpPath) + name + "." + std::to_string(::GetCurrentProcessId());
+			}
+
+			~TempDirectory()
+			{
+				WIN32_FIND_DATAA data;
+				auto hFind = ::FindFirstFileA((path + "\\*").c_str(), &data);
+				if (hFind != INVALID_HANDLE_VALUE)
+				{
+					do
+					{
+						if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+						{
+							::DeleteFileA((path + "\\" + data.cFileName).c_str());
+						}
+					} while (::FindNextFileA(hFind, &data));
+					::FindClose(hFind);
+				}
+				::RemoveDirectoryA(path.c_str());
+			}
+
+			std::string path;
+		};
+
+	public:
+		TEST_METHOD(Store_OverMemoryLimit_EvictsLeastRecentlyUsed)
+		{
+			ResultCache cache(100);
+			cache.Store("first", ResultCache::Result{ 0, std::string(40, 'a'), "" });
+			cache.Store("second", ResultCache::Result{ 0, std::string(40, 'b'), "" });
+
+			ResultCache::Result result;
+			Assert::IsTrue(cache.Find("first", result), L"first result is missing");
+			cache.Store("third", ResultCache::Result{ 0, std::string(40, 'c'), "" });
+
+			Assert::IsFalse(cache.Find("second", result), L"least recently used result was not evicted");
+			Assert::IsTrue(cache.Find("first", result), L"recently used result was evicted");
+			Assert::AreEqual(std::string(40, 'a'), result.stdOut);
+		}
+
+		TEST_METHOD(Find_InDirectoryOfOtherCache_ReturnsResult)
+		{
+			TempDirectory directory("PipedProcessResultCacheTests");
+
+			{
+				ResultCache writer(1024, directory.path);
+				writer.Store("key", ResultCache::Result{ 3, std::string("out\0put", 7), "error" });
+			}
+
+			ResultCache reader(1024, directory.path);
+			ResultCache::Result result;
+			Assert::IsTrue(reader.Find("key", result), L"result was not found in the directory");
+			Assert::AreEqual(static_cast<DWORD>(3), result.exitCode);
+			Assert::AreEqual(std::string("out\0put", 7), result.stdOut);
+			Assert::AreEqual(std::string("error"), result.stdErr);
+			Assert::IsFalse(reader.Find("other key", result), L"unknown key was found");
+		}
+
+		TEST_METHOD(Store_OverDirectoryLimit_DeletesOldestEntries)
+		{
+			TempDirectory directory("PipedProcessResultCacheTrimTests");
+
+			{
+				ResultCache writer(1024, directory.path, 300); // room for two entries of about 140 bytes
+				writer.Store("first", ResultCache::Result{ 0, std::string(100, 'a'), "" });
+				::Sleep(20); // distinct write times
+				writer.Store("second", ResultCache::Result{ 0, std::string(100, 'b'), "" });
+				::Sleep(20);
+				writer.Store("third", ResultCache::Result{ 0, std::string(100, 'c'), "" });
+			}
+
+			ResultCache reader(1024, directory.path, 300);
+			ResultCache::Result result;
+			Assert::IsFalse(reader.Find("first", result), L"oldest entry was not deleted");
+			Assert::IsTrue(reader.Find("third", result), L"newest entry was deleted");
+			Assert::AreEqual(std::string(100, 'c'), result.stdOut);
+		}
+
+		TEST_METHOD(Run_SameArgumentsAndStdIn_IsTakenFromCache)
+		{
+			ResultCache cache;
+			PipedProcess process;
+			process.SetResultCache(&cache);
+
+			const std::string input = "cached input";
+			process.SetStdInData(input.data(), input.size());
+			int exitCode = process.Run(GetCmdPath().c_str(), "/c more");
+			Assert::AreEqual(0, exitCode, L"exit code is not 0");
+			Assert::IsFalse(process.IsResultFromCache(), L"first run was taken from cache");
+			auto output = process.FetchStdOutData();
+
+			process.SetStdInData(input.data(), input.size());
+			exitCode = process.Run(GetCmdPath().c_str(), "/c more");
+			Assert::AreEqual(0, exitCode, L"exit code is not 0");
+			Assert::IsTrue(process.IsResultFromCache(), L"second run was not taken from cache");
+			Assert::AreEqual(output, process.FetchStdOutData());
+
+			const std::string otherInput = "other input";
+			process.SetStdInData(otherInput.data(), otherInput.size());
+			process.Run(GetCmdPath().c_str(), "/c more");
+			Assert::IsFalse(process.IsResultFromCache(), L"run with other stdin was taken from cache");
+		}
+	};
+}
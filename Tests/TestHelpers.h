@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdlib>
+#include <string>
+
+namespace PipedProcessTests
+{
+	// Path of the command interpreter (COMSPEC) that runs the test commands
+	inline std::string const& GetCmdPath()
+	{
+		static const std::string cmdPath = []()
+		{
+			// Use _dupenv_s instead of getenv as getenv is not thread-safe
+			std::string path;
+			char* envValue = nullptr;
+			size_t envSize = 0;
+			_dupenv_s(&envValue, &envSize, "COMSPEC");
+			if (envValue != nullptr)
+			{
+				path = envValue;
+				free(envValue);
+			}
+			return path;
+		}();
+		return cmdPath;
+	}
+}